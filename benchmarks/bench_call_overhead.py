@@ -0,0 +1,44 @@
+"""Per-call overhead of filter objects on small chunks.
+
+Run from the top of the source tree after building the extension in place::
+
+    PYTHONPATH=src python benchmarks/bench_call_overhead.py
+
+Each line is the best of several runs, in nanoseconds per call.
+"""
+import argparse
+import timeit
+
+import bcj
+
+
+def bench(label, stmt, number, repeat):
+    best = min(timeit.repeat(stmt, number=number, repeat=repeat))
+    print(f"{label:<40} {best / number * 1e9:10.1f} ns")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--size", type=int, default=4096, help="chunk size, 4096 by default")
+    parser.add_argument("--number", type=int, default=100000, help="calls in a run")
+    parser.add_argument("--repeat", type=int, default=5, help="runs to take the best of")
+    args = parser.parse_args()
+
+    # a chunk without branches, so that the time is the call rather than the conversion
+    chunk = bytes(args.size)
+    empty = b""
+    encoder = bcj.ARMEncoder()
+    decoder = bcj.ARMDecoder()
+    print(f"bcj {bcj.__version__}, {type(encoder).__module__}, {args.size} byte chunks")
+    bench("ARMEncoder()", bcj.ARMEncoder, args.number, args.repeat)
+    bench("ARMDecoder(start_offset=4096)", lambda: bcj.ARMDecoder(start_offset=4096), args.number, args.repeat)
+    bench("encode(b'')", lambda: encoder.encode(empty), args.number, args.repeat)
+    bench("encode(chunk)", lambda: encoder.encode(chunk), args.number, args.repeat)
+    bench("encode(chunk, as_list=False)", lambda: encoder.encode(chunk, as_list=False), args.number, args.repeat)
+    bench("decode(chunk)", lambda: decoder.decode(chunk), args.number, args.repeat)
+    bench("decode(chunk, -1)", lambda: decoder.decode(chunk, -1), args.number, args.repeat)
+    bench("encoder.flush()", encoder.flush, args.number, args.repeat)
+
+
+if __name__ == "__main__":
+    main()
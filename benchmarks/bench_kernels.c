@@ -0,0 +1,218 @@
+/**
+ * Throughput of the converter kernels, and a check that the variants of a converter agree.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Build with the bench_kernels CMake target, then run on an executable, for example
+ * x86_3.bin and bcj_3.bin from tests/data/src.zip:
+ *
+ *     bench_kernels x86_3.bin [repeat]
+ *
+ * Each kernel encodes and decodes the whole file in place, and each line is the best of
+ * the runs in MiB/s. The output of every variant is compared with the reference kernel of its
+ * architecture, on the whole file and in chunks of odd sizes that carry the state over.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Bra.h"
+
+/* bra86_table.c */
+SizeT x86_Convert_Table(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding);
+
+typedef SizeT (*BCJBench_func)(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding);
+
+typedef struct {
+    const char *name;
+    /* the kernel this one must give the same output as, NULL for a reference kernel */
+    const char *reference;
+    BCJBench_func func;
+    /* nonzero when the CPU can run the kernel, NULL for any CPU */
+    int (*supported)(void);
+} BCJBench_kernel;
+
+static SizeT
+BCJBench_x86(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding) {
+    return x86_Convert(data, size, ip, state, encoding);
+}
+
+static SizeT
+BCJBench_x86_table(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding) {
+    return x86_Convert_Table(data, size, ip, state, encoding);
+}
+
+#ifdef BRA_X86_AVX512
+static SizeT
+BCJBench_x86_avx512(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding) {
+    return x86_Convert_Avx512(data, size, ip, state, encoding);
+}
+#endif
+
+#define BCJBENCH_RISC(name, func) \
+    static SizeT name(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding) { \
+        (void) state; \
+        return func(data, size, ip, encoding); \
+    }
+
+BCJBENCH_RISC(BCJBench_arm, ARM_Convert)
+BCJBENCH_RISC(BCJBench_armt, ARMT_Convert)
+BCJBENCH_RISC(BCJBench_ppc, PPC_Convert)
+BCJBENCH_RISC(BCJBench_sparc, SPARC_Convert)
+BCJBENCH_RISC(BCJBench_ia64, IA64_Convert)
+BCJBENCH_RISC(BCJBench_arm64, ARM64_Convert)
+
+static const BCJBench_kernel kernels[] = {
+    {"x86", NULL, BCJBench_x86, NULL},
+    /* x86_Convert dispatches to the AVX-512 kernel when it can, so that is checked against the table */
+    {"x86 table", "x86", BCJBench_x86_table, NULL},
+#ifdef BRA_X86_AVX512
+    {"x86 avx512", "x86 table", BCJBench_x86_avx512, x86_Avx512Supported},
+#endif
+    {"arm", NULL, BCJBench_arm, NULL},
+    {"armt", NULL, BCJBench_armt, NULL},
+    {"ppc", NULL, BCJBench_ppc, NULL},
+    {"sparc", NULL, BCJBench_sparc, NULL},
+    {"ia64", NULL, BCJBench_ia64, NULL},
+    {"arm64", NULL, BCJBench_arm64, NULL},
+};
+
+#define BCJBENCH_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static double
+BCJBench_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* Convert data in chunks of the given sizes in turn, as a stream, and return the bytes converted. */
+static SizeT
+BCJBench_stream(const BCJBench_kernel *kernel, Byte *data, SizeT size, const SizeT *chunks, int encoding) {
+    SizeT pos = 0;
+    UInt32 state = 0;
+    unsigned i = 0;
+
+    while (pos < size) {
+        SizeT len = chunks[i++ % 4];
+        if (len > size - pos) {
+            len = size - pos;
+        }
+        if (len < 5 && pos + len < size) {
+            len = size - pos < 5 ? size - pos : 5;
+        }
+        {
+            SizeT done = kernel->func(data + pos, len, (UInt32) pos, &state, encoding);
+            if (done == 0) {
+                break;
+            }
+            pos += done;
+        }
+    }
+    return pos;
+}
+
+static const BCJBench_kernel *
+BCJBench_find(const char *name) {
+    for (size_t i = 0; i < BCJBENCH_KERNELS; i++) {
+        if (strcmp(kernels[i].name, name) == 0) {
+            return &kernels[i];
+        }
+    }
+    return NULL;
+}
+
+/* Return 0 if the kernel gives the same output as its reference, in one call and in chunks. */
+static int
+BCJBench_check(const BCJBench_kernel *kernel, const Byte *src, SizeT size, Byte *expect, Byte *actual) {
+    static const SizeT chunks[4] = {4099, 5, 65537, 13};
+    const BCJBench_kernel *reference = BCJBench_find(kernel->reference);
+
+    for (int encoding = 0; encoding < 2; encoding++) {
+        for (int chunked = 0; chunked < 2; chunked++) {
+            SizeT expectLen, actualLen;
+            memcpy(expect, src, size);
+            memcpy(actual, src, size);
+            if (chunked) {
+                expectLen = BCJBench_stream(reference, expect, size, chunks, encoding);
+                actualLen = BCJBench_stream(kernel, actual, size, chunks, encoding);
+            } else {
+                UInt32 expectState = 0, actualState = 0;
+                expectLen = reference->func(expect, size, 0, &expectState, encoding);
+                actualLen = kernel->func(actual, size, 0, &actualState, encoding);
+                if (expectState != actualState) {
+                    expectLen = 0;
+                }
+            }
+            if (expectLen != actualLen || memcmp(expect, actual, size) != 0) {
+                fprintf(stderr, "%s: output differs from %s when %s%s\n", kernel->name, reference->name,
+                        encoding ? "encoding" : "decoding", chunked ? " in chunks" : "");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv) {
+    FILE *f;
+    long length;
+    SizeT size;
+    Byte *src, *work, *spare;
+    int repeat = argc > 2 ? atoi(argv[2]) : 20;
+    int failed = 0;
+
+    if (argc < 2 || repeat < 1) {
+        fprintf(stderr, "usage: %s FILE [REPEAT]\n", argv[0]);
+        return 2;
+    }
+    f = fopen(argv[1], "rb");
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (length = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) != 0) {
+        perror(argv[1]);
+        return 2;
+    }
+    size = (SizeT) length;
+    src = (Byte *) malloc(size);
+    work = (Byte *) malloc(size);
+    spare = (Byte *) malloc(size);
+    if (src == NULL || work == NULL || spare == NULL || fread(src, 1, size, f) != size) {
+        perror(argv[1]);
+        return 2;
+    }
+    fclose(f);
+
+    printf("%s, %lu bytes, best of %d\n", argv[1], (unsigned long) size, repeat);
+    for (size_t k = 0; k < BCJBENCH_KERNELS; k++) {
+        const BCJBench_kernel *kernel = &kernels[k];
+        double best[2] = {0, 0};
+        if (kernel->supported != NULL && !kernel->supported()) {
+            printf("%-20s not supported by this CPU\n", kernel->name);
+            continue;
+        }
+        if (kernel->reference != NULL && BCJBench_check(kernel, src, size, spare, work) != 0) {
+            failed = 1;
+            continue;
+        }
+        for (int encoding = 0; encoding < 2; encoding++) {
+            for (int i = 0; i < repeat; i++) {
+                UInt32 state = 0;
+                double start, elapsed;
+                memcpy(work, src, size);
+                start = BCJBench_now();
+                kernel->func(work, size, 0, &state, encoding);
+                elapsed = BCJBench_now() - start;
+                if (i == 0 || elapsed < best[encoding]) {
+                    best[encoding] = elapsed;
+                }
+            }
+        }
+        printf("%-20s encode %8.1f MiB/s  decode %8.1f MiB/s\n", kernel->name,
+               (double) size / best[1] / (1 << 20), (double) size / best[0] / (1 << 20));
+    }
+    free(src);
+    free(work);
+    free(spare);
+    return failed;
+}
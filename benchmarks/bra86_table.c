@@ -0,0 +1,99 @@
+/**
+ * Table-driven variant of the x86 converter, kept for comparison in bench_kernels.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * With the SWAR candidate search of BraSwar.h both kernels spend most of the time in the search,
+ * and the branches of x86_Convert on the rare candidates cost less than computing every conversion;
+ * x86_Convert is faster on all test files, so this kernel is not part of the library.
+ */
+#include "Bra.h"
+#include "BraSwar.h"
+
+#define Test86MSByte(b) ((((b) + 1) & 0xFE) == 0)
+
+/*
+x86_Convert_Table is x86_Convert of src/ext/Bra86.c with the prev-mask state machine taken
+from a table.
+
+The entry for the mask before a candidate, its distance from the previous position (0 to 3,
+where 3 stands for all longer distances) and the Test86MSByte() results of the four bytes
+after it gives the next mask, whether the candidate is converted, and the mask the conversion
+uses. The conversion itself is computed for every candidate and stored only when it applies,
+so no branch depends on the data except the search for the next E8/E9 byte.
+*/
+
+#define X86_SHIFTED(m, d) ((d) > 2 ? 0 : (m) >> (d))
+#define X86_SKIP(m, t) ((m) != 0 && ((m) > 4 || (m) == 3 || (((t) >> ((m) >> 1)) & 1)))
+#define X86_CONVERT(m, t) (!X86_SKIP(m, t) && ((t) >> 3))
+#define X86_ENTRY_M(m, t) ((X86_CONVERT(m, t) ? 8 : ((m) >> 1) | 4) | ((m) << 4))
+#define X86_ENTRY(m, d, t) X86_ENTRY_M(X86_SHIFTED(m, d), t)
+#define X86_TESTS(m, d) \
+  X86_ENTRY(m, d, 0), X86_ENTRY(m, d, 1), X86_ENTRY(m, d, 2), X86_ENTRY(m, d, 3), \
+  X86_ENTRY(m, d, 4), X86_ENTRY(m, d, 5), X86_ENTRY(m, d, 6), X86_ENTRY(m, d, 7), \
+  X86_ENTRY(m, d, 8), X86_ENTRY(m, d, 9), X86_ENTRY(m, d, 10), X86_ENTRY(m, d, 11), \
+  X86_ENTRY(m, d, 12), X86_ENTRY(m, d, 13), X86_ENTRY(m, d, 14), X86_ENTRY(m, d, 15)
+#define X86_DISTANCES(m) X86_TESTS(m, 0), X86_TESTS(m, 1), X86_TESTS(m, 2), X86_TESTS(m, 3)
+
+/* index: mask << 6 | distance << 4 | tests; entry: used mask << 4 | convert << 3 | next mask */
+static const Byte x86_MaskTable[8 * 4 * 16] = {
+  X86_DISTANCES(0), X86_DISTANCES(1), X86_DISTANCES(2), X86_DISTANCES(3),
+  X86_DISTANCES(4), X86_DISTANCES(5), X86_DISTANCES(6), X86_DISTANCES(7)
+};
+
+SizeT x86_Convert_Table(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding)
+{
+  SizeT pos = 0;
+  UInt32 mask = *state & 7;
+  /* added to the address once, and again when the mask bytes are flipped */
+  UInt32 delta = encoding ? 0 : (UInt32)0 - 1;
+  if (size < 5)
+    return 0;
+  size -= 4;
+  ip += 5;
+
+  for (;;)
+  {
+    Byte *p = data + pos;
+    const Byte *limit = data + size;
+    BRA_SWAR_SKIP(p, limit, BraSwar_x86)
+    for (; p < limit; p++)
+      if ((*p & 0xFE) == 0xE8)
+        break;
+
+    {
+      SizeT d = (SizeT)(p - data - pos);
+      unsigned e, m, sh, tests;
+      UInt32 v, w, cur, fix, conv;
+      pos = (SizeT)(p - data);
+      if (p >= limit)
+      {
+        *state = (d > 2 ? 0 : mask >> (unsigned)d);
+        return pos;
+      }
+      tests = (unsigned)Test86MSByte(p[1])
+          | ((unsigned)Test86MSByte(p[2]) << 1)
+          | ((unsigned)Test86MSByte(p[3]) << 2)
+          | ((unsigned)Test86MSByte(p[4]) << 3);
+      e = x86_MaskTable[(mask << 6) | ((d > 3 ? 3 : (unsigned)d) << 4) | tests];
+      m = e >> 4;
+      mask = e & 7;
+      conv = (e >> 3) & 1;
+
+      w = ((UInt32)p[4] << 24) | ((UInt32)p[3] << 16) | ((UInt32)p[2] << 8) | ((UInt32)p[1]);
+      cur = ((ip + (UInt32)pos) ^ delta) - delta;
+      v = w + cur;
+      sh = (m & 6) << 2;
+      fix = (UInt32)0 - (UInt32)(m != 0 && Test86MSByte((Byte)(v >> sh)));
+      v ^= (((UInt32)0x100 << sh) - 1) & fix;
+      v += cur & fix;
+      v = (v & 0xFFFFFF) | ((UInt32)(Byte)(0 - ((v >> 24) & 1)) << 24);
+      w ^= (w ^ v) & ((UInt32)0 - conv);
+      p[1] = (Byte)w;
+      p[2] = (Byte)(w >> 8);
+      p[3] = (Byte)(w >> 16);
+      p[4] = (Byte)(w >> 24);
+      pos += 1 + (conv << 2);
+    }
+  }
+}
@@ -9,7 +9,7 @@ from setuptools import Extension, setup
 from setuptools.command.build_ext import build_ext
 from setuptools.command.egg_info import egg_info
 
-sources = ["src/ext/Bra.c", "src/ext/Bra86.c", "src/ext/BraIA64.c", "src/ext/_bcjmodule.c"]
+sources = ["src/ext/Bra.c", "src/ext/Bra86.c", "src/ext/Bra86Avx512.c", "src/ext/BraIA64.c", "src/ext/Arena.c", "src/ext/Crc.c", "src/ext/FileIO.c", "src/ext/Pipe.c", "src/ext/_bcjmodule.c"]
 kwargs = {
     "name": "bcj._bcj",
     "include_dirs": ["src/ext"],
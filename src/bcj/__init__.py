@@ -10,6 +10,8 @@ except ImportError:
     from importlib_metadata import version  # type: ignore
 try:
     from ._bcj import (
+        ARM64Decoder,
+        ARM64Encoder,
         ARMDecoder,
         ARMEncoder,
         ARMTDecoder,
@@ -22,10 +24,14 @@ try:
         PPCEncoder,
         SparcDecoder,
         SparcEncoder,
+        filter_file,
+        pipe,
     )
 except ImportError:
     try:
         from ._bcjfilter import (
+            ARM64Decoder,
+            ARM64Encoder,
             ARMDecoder,
             ARMEncoder,
             ARMTDecoder,
@@ -38,12 +44,16 @@ except ImportError:
             PPCEncoder,
             SparcDecoder,
             SparcEncoder,
+            filter_file,
+            pipe,
         )
     except ImportError:
         msg = "pybcj module: Neither C implementation nor Python implementation can be imported."
         raise ImportError(msg)
 
 __all__ = (
+    ARM64Decoder,
+    ARM64Encoder,
     ARMDecoder,
     ARMEncoder,
     ARMTDecoder,
@@ -56,6 +66,8 @@ __all__ = (
     PPCEncoder,
     SparcDecoder,
     SparcEncoder,
+    filter_file,
+    pipe,
 )
 
 __copyright__ = "Copyright (C) 2021 Hiroshi Miura"
@@ -2,26 +2,90 @@
 # Copyright (c) 2019,2020,2022 Hiroshi Miura <miurahr@linux.com>
 # SPDX-License-Identifier: LGPL-2.1-or-later
 #
+import copy
+import errno
+import functools
+import os
 import struct
-from typing import Union
+import zlib
+from typing import List, Optional, Tuple, Union
 
 
-class BCJFilter:
+def _crc64_table() -> list:
+    table = []
+    for i in range(256):
+        r = i
+        for _ in range(8):
+            r = (r >> 1) ^ (0xC96C5795D7870F42 if r & 1 else 0)
+        table.append(r)
+    return table
+
+
+_CRC64_TABLE = _crc64_table()
+
 
-    _mask_to_allowed_number = [0, 1, 2, 4, 8, 9, 10, 12]
-    _mask_to_bit_number = [0, 1, 2, 2, 3, 3, 3, 3]
+def _crc64(data: Union[bytes, bytearray, memoryview], crc: int = 0) -> int:
+    crc ^= 0xFFFFFFFFFFFFFFFF
+    for b in bytes(data):
+        crc = _CRC64_TABLE[(crc ^ b) & 0xFF] ^ (crc >> 8)
+    return crc ^ 0xFFFFFFFFFFFFFFFF
 
-    def __init__(self, func, readahead: int, is_encoder: bool, stream_size: int = 0):
+
+class BCJFilter:
+    def __init__(
+        self,
+        func,
+        readahead: int,
+        is_encoder: bool,
+        stream_size: Optional[int] = None,
+        checksum: Optional[str] = None,
+        start_offset: int = 0,
+        state: int = 0,
+        index_interval: int = 0,
+        alignment: int = 1,
+    ):
         self.is_encoder: bool = is_encoder
+        self._alignment: int = alignment
         #
-        self.prev_mask: int = 0
-        self.prev_pos: int = -5
-        self.current_position: int = 0
-        self.stream_size: int = stream_size  # should initialize in child class
+        if not 0 <= state <= 7:
+            raise ValueError("state should be in range 0 to 7.")
+        self._check_start_offset(start_offset)
+        self.state: int = state
+        self.current_position: int = start_offset
+        self.stream_size: Optional[int] = stream_size  # None for encoders and unknown size
+        self.remaining: Optional[int] = stream_size
         self.buffer = bytearray()
+        self._pending = bytearray()
+        self.needs_input: bool = True
         #
         self._method = func
         self._readahead = readahead
+        #
+        if checksum == "crc32":
+            self._check_func = zlib.crc32
+        elif checksum == "crc64":
+            self._check_func = _crc64
+        elif checksum is None:
+            self._check_func = None
+        else:
+            raise ValueError("Unsupported checksum: {}".format(checksum))
+        self._check: int = 0
+        #
+        self._position: int = 0
+        self._index_interval: int = index_interval
+        self._index: List[Tuple[int, int, int]] = []
+        if index_interval > 0:
+            self._index_add()
+
+    def _index_add(self) -> None:
+        self._index.append((self._position, self.current_position & 0xFFFFFFFF, self.state))
+        self._index_next = (self._position // self._index_interval + 1) * self._index_interval
+
+    def _advance(self, pos: int) -> None:
+        # checkpoints are taken only at call boundaries
+        self._position += pos
+        if self._index_interval > 0 and self._position >= self._index_next:
+            self._index_add()
 
     def sparc_code(self) -> int:
         limit: int = len(self.buffer) - 4
@@ -40,7 +104,7 @@ class BCJFilter:
                 dest = (((0 - ((dest >> 22) & 1)) << 22) & 0x3FFFFFFF) | (dest & 0x3FFFFF) | 0x40000000
                 self.buffer[i : i + 4] = struct.pack(">L", dest)
             i += 4
-        self.current_position = i
+        self.current_position += i
         return i
 
     def ppc_code(self) -> int:
@@ -50,16 +114,15 @@ class BCJFilter:
             # PowerPC branch 6(48) 24(Offset) 1(Abs) 1(Link)
             distance: int = self.current_position + i
             if self.buffer[i] & 0xFC == 0x48 and self.buffer[i + 3] & 0x03 == 1:
-                src = struct.unpack(">L", self.buffer[i : i + 4])[0] & 0x3FFFFFC
+                src = struct.unpack(">L", self.buffer[i : i + 4])[0] & 0x3FFFFFF
                 if self.is_encoder:
                     dest = src + distance
                 else:
                     dest = src - distance
-                # lsb = int(self.buffer[i + 3]) & 0x03 == 1
-                dest = (0x48 << 24) | (dest & 0x03FFFFFF) | 1
+                dest = (0x48 << 24) | (dest & 0x03FFFFFF)
                 self.buffer[i : i + 4] = struct.pack(">L", dest)
             i += 4
-        self.current_position = i
+        self.current_position += i
         return i
 
     def _unpack_thumb(self, b: Union[bytearray, bytes, memoryview]) -> int:
@@ -81,13 +144,12 @@ class BCJFilter:
         i: int = 0
         while i <= limit:
             if self.buffer[i + 1] & 0xF8 == 0xF0 and self.buffer[i + 3] & 0xF8 == 0xF8:
-                src = self._unpack_thumb(self.buffer[i : i + 4]) << 1
-                distance: int = self.current_position + i + 4
+                src = self._unpack_thumb(self.buffer[i : i + 4])
+                distance: int = (self.current_position + i + 4) >> 1
                 if self.is_encoder:
                     dest = src + distance
                 else:
                     dest = src - distance
-                dest >>= 1
                 self.buffer[i : i + 4] = self._pack_thumb(dest)
                 i += 2
             i += 2
@@ -110,155 +172,360 @@ class BCJFilter:
         self.current_position += i
         return i
 
+    def arm64_code(self) -> int:
+        limit = len(self.buffer) - 4
+        i = 0
+        while i <= limit:
+            instr = int.from_bytes(self.buffer[i : i + 4], "little")
+            pc = (self.current_position + i) & 0xFFFFFFFF
+            if instr >> 26 == 0x25:
+                # BL, 26-bit offset in words
+                distance = pc >> 2
+                if not self.is_encoder:
+                    distance = -distance
+                instr = 0x94000000 | ((instr + distance) & 0x03FFFFFF)
+                self.buffer[i : i + 4] = instr.to_bytes(4, "little")
+            elif instr & 0x9F000000 == 0x90000000:
+                # ADRP, 21-bit offset in 4 KiB pages; only the ones within +-512 MiB are converted
+                src = ((instr >> 29) & 3) | ((instr >> 3) & 0x001FFFFC)
+                if (src + 0x00020000) & 0x001C0000 == 0:
+                    distance = pc >> 12
+                    if not self.is_encoder:
+                        distance = -distance
+                    dest = (src + distance) & 0xFFFFFFFF
+                    instr &= 0x9000001F
+                    instr |= (dest & 3) << 29
+                    instr |= (dest & 0x0003FFFC) << 3
+                    instr |= -(dest & 0x00020000) & 0x00E00000
+                    self.buffer[i : i + 4] = instr.to_bytes(4, "little")
+            i += 4
+        self.current_position += i
+        return i
+
+    @staticmethod
+    def _test86_ms_byte(b: int) -> bool:
+        return ((b + 1) & 0xFE) == 0
+
     def x86_code(self) -> int:
         """
-        The code algorithm from liblzma/simple/x86.c
-        It is slightly different from LZMA-SDK's bra86.c
+        The code algorithm from LZMA SDK's Bra86.c
         :return: buffer position
         """
         size: int = len(self.buffer)
         if size < 5:
             return 0
-        if self.current_position - self.prev_pos > 5:
-            self.prev_pos = self.current_position - 5
-        view = memoryview(self.buffer)
-        limit: int = size - 5
-        buffer_pos: int = 0
-        pos1: int = 0
-        pos2: int = 0
-        while buffer_pos <= limit:
-            # --
-            # The following is pythonic way as same as
-            # if self.buffer[buffer_pos] not in [0xe9, 0xe8]:
-            #    buffer_pos += 1
-            #     continue
-            # --
-            if pos1 >= 0:
-                pos1 = self.buffer.find(0xE9, buffer_pos, limit)
-            if pos2 >= 0:
-                pos2 = self.buffer.find(0xE8, buffer_pos, limit)
-            if pos1 < 0 and pos2 < 0:
-                buffer_pos = limit + 1
+        buf = self.buffer
+        limit: int = size - 4
+        ip: int = self.current_position + 5
+        mask: int = self.state & 7
+        pos: int = 0
+        pos_e8: int = -1
+        pos_e9: int = -1
+        while True:
+            # find next 0xE8 or 0xE9 from pos, with cached search results
+            if pos_e8 < pos:
+                pos_e8 = buf.find(0xE8, pos, limit)
+                if pos_e8 < 0:
+                    pos_e8 = limit
+            if pos_e9 < pos:
+                pos_e9 = buf.find(0xE9, pos, limit)
+                if pos_e9 < 0:
+                    pos_e9 = limit
+            p = max(min(pos_e8, pos_e9), pos)
+            d = p - pos
+            pos = p
+            if p >= limit:
+                self.state = 0 if d > 2 else mask >> d
                 break
-            elif pos1 < 0:
-                buffer_pos = pos2
-            elif pos2 < 0:
-                buffer_pos = pos1
+            if d > 2:
+                mask = 0
             else:
-                buffer_pos = min(pos1, pos2)
-            # --
-            offset = self.current_position + buffer_pos - self.prev_pos
-            self.prev_pos = self.current_position + buffer_pos
-            if offset > 5:
-                self.prev_mask = 0
-            else:
-                for i in range(offset):
-                    self.prev_mask &= 0x77
-                    self.prev_mask <<= 1
-            # note:
-            # condition (self.prev_mask >> 1) in [0, 1, 2, 4, 8, 9, 10, 12]
-            # is as same as
-            # condition _mask_to_allowed_status[(self.prev_mask >> 1) & 0x7] and (self.prev_mask >> 1) < 0x10:
-            # when _mask_to_allowed_status = [True, True, True, False, True, False, False, False]
-            #
-            if view[buffer_pos + 4] in [0, 0xFF] and (self.prev_mask >> 1) in self._mask_to_allowed_number:
-                jump_target = self.buffer[buffer_pos + 1 : buffer_pos + 5]
-                src = struct.unpack("<L", jump_target)[0]
-                distance = self.current_position + buffer_pos + 5
-                idx = self._mask_to_bit_number[self.prev_mask >> 1]
-                while True:
-                    if self.is_encoder:
-                        dest = (src + distance) & 0xFFFFFFFF  # uint32 behavior
-                    else:
-                        dest = (src - distance) & 0xFFFFFFFF
-                    if self.prev_mask == 0:
-                        break
-                    b = 0xFF & (dest >> (24 - idx * 8))
-                    if not (b == 0 or b == 0xFF):
-                        break
-                    src = dest ^ ((1 << (32 - idx * 8)) - 1) & 0xFFFFFFFF
-                write_view = view[buffer_pos + 1 : buffer_pos + 5]
-                write_view[0:3] = (dest & 0xFFFFFF).to_bytes(3, "little")
-                write_view[3:4] = [b"\x00", b"\xff"][(dest >> 24) & 1]  # (~(((dest >> 24) & 1) - 1)) & 0xFF
-                buffer_pos += 5
-                self.prev_mask = 0
+                mask >>= d
+                if mask != 0 and (mask > 4 or mask == 3 or self._test86_ms_byte(buf[p + (mask >> 1) + 1])):
+                    mask = (mask >> 1) | 4
+                    pos += 1
+                    continue
+            if self._test86_ms_byte(buf[p + 4]):
+                v = int.from_bytes(buf[p + 1 : p + 5], "little")
+                cur = (ip + pos) & 0xFFFFFFFF
+                pos += 5
+                if self.is_encoder:
+                    v = (v + cur) & 0xFFFFFFFF
+                else:
+                    v = (v - cur) & 0xFFFFFFFF
+                if mask != 0:
+                    sh = (mask & 6) << 2
+                    if self._test86_ms_byte((v >> sh) & 0xFF):
+                        v ^= ((0x100 << sh) - 1) & 0xFFFFFFFF
+                        if self.is_encoder:
+                            v = (v + cur) & 0xFFFFFFFF
+                        else:
+                            v = (v - cur) & 0xFFFFFFFF
+                    mask = 0
+                buf[p + 1 : p + 4] = (v & 0xFFFFFF).to_bytes(3, "little")
+                buf[p + 4] = (0 - ((v >> 24) & 1)) & 0xFF
             else:
-                buffer_pos += 1
-                self.prev_mask |= 1
-                if self.buffer[buffer_pos + 3] in [0, 0xFF]:
-                    self.prev_mask |= 0x10
-        self.current_position += buffer_pos
-        return buffer_pos
-
-    def decode(self, data: Union[bytes, bytearray, memoryview], max_length: int = -1) -> bytes:
+                mask = (mask >> 1) | 4
+                pos += 1
+        self.current_position += pos
+        return pos
+
+    def decode(self, data, max_length: int = -1, *, as_list: bool = False):
+        pieces = (data or [b""]) if isinstance(data, (list, tuple)) else [data]
+        if max_length >= 0:
+            return self._result([self._decode(b"".join(pieces), max_length)], as_list)
+        return self._result([self._decode(piece, -1) for piece in pieces], as_list)
+
+    def encode(self, data, *, as_list: bool = False):
+        pieces = (data or [b""]) if isinstance(data, (list, tuple)) else [data]
+        return self._result([self._encode(piece) for piece in pieces], as_list)
+
+    def encode_to(self, sink, data, *, flush: bool = False) -> int:
+        out = self.encode(data)
+        if flush:
+            out += self.flush()
+        return self._write(sink, out)
+
+    def decode_to(self, sink, data, *, flush: bool = False) -> int:
+        out = self.decode(data)
+        if flush:
+            out += self.flush()
+        return self._write(sink, out)
+
+    @staticmethod
+    def _write(sink, data: bytes) -> int:
+        if isinstance(sink, int):
+            if sink < 0:
+                raise ValueError("file descriptor should be a non-negative int.")
+            write = functools.partial(os.write, sink)
+        elif hasattr(sink, "write"):
+            write = sink.write
+        else:
+            raise TypeError("sink should be a file descriptor or have a write() method.")
+        view = memoryview(data)
+        pos = 0
+        while pos < len(view):
+            n = write(view[pos:])
+            if n is None:
+                raise BlockingIOError("sink is not ready for writing.")
+            pos += n
+        return pos
+
+    @staticmethod
+    def _result(outputs: List[bytes], as_list: bool):
+        if as_list:
+            return [memoryview(out) for out in outputs]
+        return b"".join(outputs)
+
+    def _decode(self, data: Union[bytes, bytearray, memoryview], max_length: int) -> bytes:
         self.buffer.extend(data)
         pos: int = self._method()
-        if self.current_position > self.stream_size - self._readahead:
-            offset: int = self.stream_size - self.current_position
-            tmp = bytes(self.buffer[: pos + offset])
-            self.current_position = self.stream_size
+        self._advance(pos)
+        if self.remaining is not None:
+            self.remaining -= pos
+        if self.remaining is not None and self.remaining <= self._readahead:
+            # flush all the data
+            tmp = bytes(self.buffer)
+            self.current_position += len(self.buffer) - pos
+            self._position += len(self.buffer) - pos
+            self.remaining -= len(self.buffer) - pos
             self.buffer = bytearray()
         else:
             tmp = bytes(self.buffer[:pos])
             self.buffer = self.buffer[pos:]
+        if self._check_func is not None:
+            self._check = self._check_func(tmp, self._check)
+        if self._pending:
+            tmp = bytes(self._pending) + tmp
+            self._pending = bytearray()
+        if 0 <= max_length < len(tmp):
+            # keep the excess for next calls
+            self._pending = bytearray(tmp[max_length:])
+            tmp = tmp[:max_length]
+        self.needs_input = not self._pending
         return tmp
 
-    def encode(self, data: Union[bytes, bytearray, memoryview]) -> bytes:
+    def _encode(self, data: Union[bytes, bytearray, memoryview]) -> bytes:
+        if self._check_func is not None:
+            self._check = self._check_func(data, self._check)
         self.buffer.extend(data)
         pos: int = self._method()
+        self._advance(pos)
         tmp = bytes(self.buffer[:pos])
         self.buffer = self.buffer[pos:]
         return tmp
 
     def flush(self) -> bytes:
-        return bytes(self.buffer)
+        tmp = bytes(self.buffer)
+        if not self.is_encoder and self._check_func is not None:
+            self._check = self._check_func(tmp, self._check)
+        self.current_position += len(tmp)
+        self._position += len(tmp)
+        if self.remaining is not None:
+            self.remaining -= len(tmp)
+        tmp = bytes(self._pending) + tmp
+        self.buffer = bytearray()
+        self._pending = bytearray()
+        self.needs_input = True
+        return tmp
+
+    def digest(self) -> int:
+        if self._check_func is None:
+            raise ValueError("checksum is not enabled for this filter.")
+        return self._check
+
+    def checkpoints(self) -> List[Tuple[int, int, int]]:
+        return list(self._index)
+
+    def reset(self, size: Optional[int] = None, *, start_offset: int = 0, state: int = 0) -> None:
+        if self.is_encoder and size is not None:
+            raise TypeError("size is not used for encoders.")
+        if not 0 <= state <= 7 or (state != 0 and self._method != self.x86_code):
+            raise ValueError("state should be in range 0 to 7.")
+        self._check_start_offset(start_offset)
+        self.stream_size = size
+        self.remaining = size
+        self.state = state
+        self.current_position = start_offset
+        self.buffer = bytearray()
+        self._pending = bytearray()
+        self.needs_input = True
+        self._check = 0
+        self._position = 0
+        self._index = []
+        if self._index_interval > 0:
+            self._index_add()
+
+    def _check_start_offset(self, start_offset: int) -> None:
+        if not 0 <= start_offset <= 0xFFFFFFFF:
+            raise ValueError("start_offset should be in range 0 to 0xFFFFFFFF.")
+        if start_offset % self._alignment != 0:
+            raise ValueError("start_offset should be a multiple of {} for this filter.".format(self._alignment))
+
+    def copy(self) -> "BCJFilter":
+        return copy.deepcopy(self)
+
+    __copy__ = copy
 
 
 class BCJDecoder(BCJFilter):
-    def __init__(self, size: int):
-        super().__init__(self.x86_code, 5, False, size)
+    def __init__(self, size: Optional[int] = None, checksum: Optional[str] = None, *, start_offset: int = 0, state: int = 0, index_interval: int = 0):
+        super().__init__(self.x86_code, 4, False, size, checksum, start_offset, state, index_interval=index_interval)
 
 
 class BCJEncoder(BCJFilter):
-    def __init__(self):
-        super().__init__(self.x86_code, 5, True)
+    def __init__(self, checksum: Optional[str] = None, *, start_offset: int = 0, state: int = 0, index_interval: int = 0):
+        super().__init__(self.x86_code, 4, True, checksum=checksum, start_offset=start_offset, state=state, index_interval=index_interval)
 
 
 class SparcDecoder(BCJFilter):
-    def __init__(self, size: int):
-        super().__init__(self.sparc_code, 4, False, size)
+    def __init__(self, size: Optional[int] = None, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.sparc_code, 3, False, size, checksum, start_offset, index_interval=index_interval, alignment=4)
 
 
 class SparcEncoder(BCJFilter):
-    def __init__(self):
-        super().__init__(self.sparc_code, 4, True)
+    def __init__(self, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.sparc_code, 3, True, checksum=checksum, start_offset=start_offset, index_interval=index_interval, alignment=4)
 
 
 class PPCDecoder(BCJFilter):
-    def __init__(self, size: int):
-        super().__init__(self.ppc_code, 4, False, size)
+    def __init__(self, size: Optional[int] = None, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.ppc_code, 3, False, size, checksum, start_offset, index_interval=index_interval, alignment=4)
 
 
 class PPCEncoder(BCJFilter):
-    def __init__(self):
-        super().__init__(self.ppc_code, 4, True)
+    def __init__(self, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.ppc_code, 3, True, checksum=checksum, start_offset=start_offset, index_interval=index_interval, alignment=4)
 
 
 class ARMTDecoder(BCJFilter):
-    def __init__(self, size: int):
-        super().__init__(self.armt_code, 4, False, size)
+    def __init__(self, size: Optional[int] = None, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.armt_code, 3, False, size, checksum, start_offset, index_interval=index_interval, alignment=2)
 
 
 class ARMTEncoder(BCJFilter):
-    def __init__(self):
-        super().__init__(self.armt_code, 4, True)
+    def __init__(self, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.armt_code, 3, True, checksum=checksum, start_offset=start_offset, index_interval=index_interval, alignment=2)
 
 
 class ARMDecoder(BCJFilter):
-    def __init__(self, size: int):
-        super().__init__(self.arm_code, 4, False, size)
+    def __init__(self, size: Optional[int] = None, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.arm_code, 3, False, size, checksum, start_offset, index_interval=index_interval, alignment=4)
 
 
 class ARMEncoder(BCJFilter):
-    def __init__(self):
-        super().__init__(self.arm_code, 4, True)
+    def __init__(self, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.arm_code, 3, True, checksum=checksum, start_offset=start_offset, index_interval=index_interval, alignment=4)
+
+
+class ARM64Decoder(BCJFilter):
+    def __init__(self, size: Optional[int] = None, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.arm64_code, 3, False, size, checksum, start_offset, index_interval=index_interval, alignment=4)
+
+
+class ARM64Encoder(BCJFilter):
+    def __init__(self, checksum: Optional[str] = None, *, start_offset: int = 0, index_interval: int = 0):
+        super().__init__(self.arm64_code, 3, True, checksum=checksum, start_offset=start_offset, index_interval=index_interval, alignment=4)
+
+
+def pipe(
+    src_fd: int,
+    dst_fd: int,
+    arch: str,
+    *,
+    encode: bool = True,
+    start_offset: int = 0,
+    state: int = 0,
+    block_size: int = 1048576,
+    blocks: int = 4,
+) -> int:
+    filters = {
+        "x86": (BCJEncoder, BCJDecoder),
+        "arm": (ARMEncoder, ARMDecoder),
+        "armt": (ARMTEncoder, ARMTDecoder),
+        "ppc": (PPCEncoder, PPCDecoder),
+        "sparc": (SparcEncoder, SparcDecoder),
+        "arm64": (ARM64Encoder, ARM64Decoder),
+    }
+    if arch not in filters:
+        raise ValueError("unknown arch '{}'.".format(arch))
+    if block_size <= 0 or blocks < 2:
+        raise ValueError("block_size should be positive and blocks at least 2.")
+    kwargs = {"start_offset": start_offset}
+    if state != 0:
+        if arch != "x86":
+            raise ValueError("state should be in range 0 to 7.")
+        kwargs["state"] = state
+    encoder, decoder = filters[arch]
+    bcj = encoder(**kwargs) if encode else decoder(**kwargs)
+    written = 0
+    while True:
+        data = os.read(src_fd, block_size)
+        if not data:
+            break
+        written += bcj.encode_to(dst_fd, data) if encode else bcj.decode_to(dst_fd, data)
+    return written + BCJFilter._write(dst_fd, bcj.flush())
+
+
+def filter_file(
+    src,
+    dst,
+    arch: str,
+    *,
+    encode: bool = True,
+    start_offset: int = 0,
+    state: int = 0,
+    block_size: int = 1048576,
+    queue_depth: int = 8,
+    direct: bool = False,
+    engine: str = "auto",
+) -> int:
+    if engine not in ("auto", "io_uring", "pread"):
+        raise ValueError("unknown engine '{}'.".format(engine))
+    if engine == "io_uring":
+        raise OSError(errno.ENOSYS, os.strerror(errno.ENOSYS))
+    if queue_depth < 2:
+        raise ValueError("block_size should be positive and queue_depth at least 2.")
+    with open(src, "rb") as fin, open(dst, "wb") as fout:
+        return pipe(fin.fileno(), fout.fileno(), arch, encode=encode, start_offset=start_offset, state=state,
+                    block_size=block_size, blocks=queue_depth)
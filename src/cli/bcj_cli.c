@@ -0,0 +1,468 @@
+/**
+ * bcj: filter stdin to stdout with the branch converters of libbcj.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Pipe.h"
+#include "bcj.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <windows.h>
+#define BCJ_READ(fd, buf, size) _read((fd), (buf), (unsigned int) (size))
+#define BCJ_WRITE(fd, buf, size) _write((fd), (buf), (unsigned int) (size))
+#define BCJ_ALIGNED_FREE(p) _aligned_free(p)
+typedef long long BCJIOSize;
+#else
+#include <unistd.h>
+#define BCJ_READ(fd, buf, size) read((fd), (buf), (size))
+#define BCJ_WRITE(fd, buf, size) write((fd), (buf), (size))
+#define BCJ_ALIGNED_FREE(p) free(p)
+typedef ssize_t BCJIOSize;
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#define BCJ_HAVE_VMSPLICE 1
+#endif
+
+#define BCJ_CLI_ALIGN 4096
+/* Largest single read or write, within the limits of all platforms */
+#define BCJ_CLI_IO_MAX (1 << 30)
+
+static const char *const archNames[] = {"x86", "arm", "armt", "ppc", "sparc", "ia64", "arm64", NULL};
+
+typedef struct {
+    int arch;
+    int encoding;
+    uint32_t startOffset;
+    unsigned threads;
+    size_t blockSize;
+    int splice;
+    int stats;
+} BCJOptions;
+
+static const char usage[] =
+"Usage: bcj [OPTION]...\n"
+"Filter branch instructions of machine code read from standard input,\n"
+"and write the result to standard output.\n"
+"\n"
+"  -a, --arch=ARCH          x86 (default), arm, armt, ppc, sparc, ia64\n"
+"                           or arm64\n"
+"  -e, --encode             convert branch targets to absolute addresses (default)\n"
+"  -d, --decode             convert them back\n"
+"  -s, --start-offset=NUM   address of the first byte of the stream, 0 by default;\n"
+"                           a multiple of 4 for arm, arm64, ppc and sparc, 2 for armt, 16 for ia64\n"
+"  -T, --threads=NUM        1 (default) filters on one thread; more than 1 reads and\n"
+"                           writes on their own threads while converting\n"
+"  -b, --block-size=SIZE    size of a buffer, 1MiB by default; K, M and G suffixes\n"
+"      --splice             when stdout is a pipe, move output pages into it with\n"
+"                           vmsplice(2) instead of write(2); only for readers that copy\n"
+"                           the data out with read(2), not ones that splice or tee it\n"
+"  -v, --stats              report size, time and throughput to standard error\n"
+"  -h, --help               show this help and exit\n"
+"  -V, --version            show the version and exit\n";
+
+static void
+BCJCli_error(const char *message, int err) {
+    if (err != 0) {
+        fprintf(stderr, "bcj: %s: %s\n", message, strerror(err));
+    } else {
+        fprintf(stderr, "bcj: %s\n", message);
+    }
+}
+
+/* Parse a number with an optional K, M or G suffix. Returns 0 or EINVAL. */
+static int
+BCJCli_number(const char *text, int suffix, unsigned long long max, unsigned long long *value) {
+    char *end;
+    unsigned long long v;
+
+    if (*text == '-' || *text == '\0') {
+        return EINVAL;
+    }
+    errno = 0;
+    v = strtoull(text, &end, 0);
+    if (errno != 0) {
+        return EINVAL;
+    }
+    if (suffix && *end != '\0' && end[1] == '\0') {
+        unsigned shift;
+        switch (*end) {
+            case 'k': case 'K': shift = 10; break;
+            case 'm': case 'M': shift = 20; break;
+            case 'g': case 'G': shift = 30; break;
+            default: return EINVAL;
+        }
+        if (v > (max >> shift)) {
+            return EINVAL;
+        }
+        v <<= shift;
+        end++;
+    }
+    if (*end != '\0' || v > max) {
+        return EINVAL;
+    }
+    *value = v;
+    return 0;
+}
+
+/*
+Match argv[*i] against a short and a long option. An option with a value takes it
+from "--name=VALUE", "-xVALUE" or the next argument, and sets *value.
+Returns 1 on a match, 0 otherwise, and -1 when the value is missing.
+*/
+static int
+BCJCli_option(int argc, char **argv, int *i, char shortName, const char *longName, const char **value) {
+    const char *arg = argv[*i];
+    size_t len = strlen(longName);
+
+    if (arg[0] == '-' && arg[1] == '-' && strncmp(arg + 2, longName, len) == 0) {
+        arg += 2 + len;
+        if (*arg == '\0') {
+            if (value == NULL) {
+                return 1;
+            }
+        } else if (*arg == '=' && value != NULL) {
+            *value = arg + 1;
+            return 1;
+        } else {
+            return 0;
+        }
+    } else if (shortName != '\0' && arg[0] == '-' && arg[1] == shortName) {
+        if (value == NULL) {
+            return arg[2] == '\0';
+        }
+        if (arg[2] != '\0') {
+            *value = arg + 2;
+            return 1;
+        }
+    } else {
+        return 0;
+    }
+    if (*i + 1 >= argc) {
+        return -1;
+    }
+    *value = argv[++*i];
+    return 1;
+}
+
+/* Returns -1 to continue, or the exit status. */
+static int
+BCJCli_parse(int argc, char **argv, BCJOptions *opts) {
+    for (int i = 1; i < argc; i++) {
+        const char *value = NULL;
+        unsigned long long n;
+        int m;
+
+        if ((m = BCJCli_option(argc, argv, &i, 'a', "arch", &value)) != 0) {
+            if (m < 0) {
+                fprintf(stderr, "bcj: option '%s' needs a value\n", argv[i]);
+                return 2;
+            }
+            opts->arch = -1;
+            for (int arch = 0; archNames[arch] != NULL; arch++) {
+                if (strcmp(archNames[arch], value) == 0) {
+                    opts->arch = arch;
+                }
+            }
+            if (opts->arch < 0) {
+                fprintf(stderr, "bcj: unknown arch '%s'\n", value);
+                return 2;
+            }
+        } else if (BCJCli_option(argc, argv, &i, 'e', "encode", NULL) > 0) {
+            opts->encoding = BCJ_ENCODE;
+        } else if (BCJCli_option(argc, argv, &i, 'd', "decode", NULL) > 0) {
+            opts->encoding = BCJ_DECODE;
+        } else if ((m = BCJCli_option(argc, argv, &i, 's', "start-offset", &value)) != 0) {
+            if (m < 0) {
+                fprintf(stderr, "bcj: option '%s' needs a value\n", argv[i]);
+                return 2;
+            }
+            if (BCJCli_number(value, 0, UINT32_MAX, &n) != 0) {
+                fprintf(stderr, "bcj: invalid start offset '%s'\n", value);
+                return 2;
+            }
+            opts->startOffset = (uint32_t) n;
+        } else if ((m = BCJCli_option(argc, argv, &i, 'T', "threads", &value)) != 0) {
+            if (m < 0) {
+                fprintf(stderr, "bcj: option '%s' needs a value\n", argv[i]);
+                return 2;
+            }
+            if (BCJCli_number(value, 0, 1024, &n) != 0 || n == 0) {
+                fprintf(stderr, "bcj: invalid number of threads '%s'\n", value);
+                return 2;
+            }
+            opts->threads = (unsigned) n;
+        } else if ((m = BCJCli_option(argc, argv, &i, 'b', "block-size", &value)) != 0) {
+            if (m < 0) {
+                fprintf(stderr, "bcj: option '%s' needs a value\n", argv[i]);
+                return 2;
+            }
+            if (BCJCli_number(value, 1, BCJ_CLI_IO_MAX, &n) != 0 || n < BCJ_CLI_ALIGN) {
+                fprintf(stderr, "bcj: invalid block size '%s', it should be 4K to 1G\n", value);
+                return 2;
+            }
+            opts->blockSize = (size_t) n;
+        } else if (BCJCli_option(argc, argv, &i, '\0', "splice", NULL) > 0) {
+            opts->splice = 1;
+        } else if (BCJCli_option(argc, argv, &i, 'v', "stats", NULL) > 0) {
+            opts->stats = 1;
+        } else if (BCJCli_option(argc, argv, &i, 'h', "help", NULL) > 0) {
+            fputs(usage, stdout);
+            return 0;
+        } else if (BCJCli_option(argc, argv, &i, 'V', "version", NULL) > 0) {
+            printf("bcj %s\n", BCJ_VersionString());
+            return 0;
+        } else {
+            fprintf(stderr, "bcj: unknown option '%s'\nTry 'bcj --help' for more information.\n", argv[i]);
+            return 2;
+        }
+    }
+    // the arch may come after the start offset
+    if (opts->startOffset % BCJ_Alignment(opts->arch) != 0) {
+        fprintf(stderr, "bcj: start offset should be a multiple of %u for %s\n",
+                BCJ_Alignment(opts->arch), archNames[opts->arch]);
+        return 2;
+    }
+    return -1;
+}
+
+static double
+BCJCli_now(void) {
+#ifdef _WIN32
+    return (double) GetTickCount64() / 1000.0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+static void *
+BCJCli_alloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, BCJ_CLI_ALIGN);
+#else
+    void *p;
+    return posix_memalign(&p, BCJ_CLI_ALIGN, size) == 0 ? p : NULL;
+#endif
+}
+
+/* Read until buf is full or at the end of input. Returns the size, or -1 with errno. */
+static BCJIOSize
+BCJCli_read(int fd, uint8_t *buf, size_t size) {
+    size_t done = 0;
+
+    while (done < size) {
+        BCJIOSize n = BCJ_READ(fd, buf + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += (size_t) n;
+    }
+    return (BCJIOSize) done;
+}
+
+/*
+Output of the single-threaded loop. With --splice and stdout a pipe, the pages of
+the output buffers are spliced into it with vmsplice(2) instead of copied. A buffer
+is used again only after more than the pipe capacity has been spliced behind it, when
+its pages have left the pipe. That is only safe when the reader copies them out with
+read(2): a reader that splices or tees them onward still refers to the pages, which
+would then change under it, so splicing is not the default.
+*/
+typedef struct {
+    int fd;
+    int splice;
+    uint8_t **buffers;
+    unsigned count;
+    unsigned next;
+} BCJOutput;
+
+static int
+BCJOutput_init(BCJOutput *out, int fd, size_t blockSize, int splice) {
+    unsigned count = 2;
+
+    out->fd = fd;
+    out->splice = 0;
+    out->next = 0;
+#ifdef BCJ_HAVE_VMSPLICE
+    struct stat st;
+    if (splice && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        int pipeSize;
+        // a pipe as large as a block is enough; the limit may make it smaller
+        fcntl(fd, F_SETPIPE_SZ, (int) (blockSize < BCJ_CLI_IO_MAX ? blockSize : BCJ_CLI_IO_MAX));
+        pipeSize = fcntl(fd, F_GETPIPE_SZ);
+        if (pipeSize > 0) {
+            // each output but the last is at least blockSize - BCJ_CARRY_MAX bytes
+            count = (unsigned) ((size_t) pipeSize / (blockSize - BCJ_CARRY_MAX)) + 2;
+            out->splice = 1;
+        }
+    }
+#else
+    (void) splice;
+#endif
+    out->count = count;
+    out->buffers = calloc(count, sizeof(uint8_t *));
+    if (out->buffers == NULL) {
+        return ENOMEM;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        out->buffers[i] = BCJCli_alloc(BCJ_UPDATE_BOUND(blockSize));
+        if (out->buffers[i] == NULL) {
+            return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+static void
+BCJOutput_free(BCJOutput *out) {
+    if (out->buffers != NULL) {
+        for (unsigned i = 0; i < out->count; i++) {
+            BCJ_ALIGNED_FREE(out->buffers[i]);
+        }
+        free(out->buffers);
+    }
+}
+
+/* The buffer to fill next. */
+static uint8_t *
+BCJOutput_buffer(BCJOutput *out) {
+    return out->buffers[out->next];
+}
+
+/* Write size bytes of the current buffer and move to the next one. Returns 0 or an errno value. */
+static int
+BCJOutput_write(BCJOutput *out, size_t size) {
+    uint8_t *buf = out->buffers[out->next];
+
+    out->next = (out->next + 1) % out->count;
+    while (size > 0) {
+        BCJIOSize n;
+#ifdef BCJ_HAVE_VMSPLICE
+        if (out->splice) {
+            struct iovec iov = {buf, size};
+            n = vmsplice(out->fd, &iov, 1, 0);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                // not spliceable after all, e.g. in a sandbox
+                out->splice = 0;
+                continue;
+            }
+        } else
+#endif
+        {
+            n = BCJ_WRITE(out->fd, buf, size < BCJ_CLI_IO_MAX ? size : BCJ_CLI_IO_MAX);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        buf += n;
+        size -= (size_t) n;
+    }
+    return 0;
+}
+
+/* Filter srcFd into dstFd on the calling thread. */
+static int
+BCJCli_filter(int srcFd, int dstFd, const BCJOptions *opts, uint64_t *written) {
+    BCJContext *ctx = NULL;
+    BCJOutput out = {0};
+    uint8_t *in;
+    int err;
+
+    in = BCJCli_alloc(opts->blockSize);
+    if (in == NULL) {
+        return ENOMEM;
+    }
+    err = BCJOutput_init(&out, dstFd, opts->blockSize, opts->splice);
+    if (err == 0) {
+        err = BCJ_ContextCreate(&ctx, opts->arch, opts->encoding, opts->startOffset, 0);
+    }
+    while (err == 0) {
+        BCJIOSize n = BCJCli_read(srcFd, in, opts->blockSize);
+        size_t outLen;
+        if (n < 0) {
+            err = errno;
+            break;
+        }
+        if (n == 0) {
+            outLen = BCJ_ContextFinish(ctx, BCJOutput_buffer(&out));
+        } else {
+            outLen = BCJ_ContextUpdate(ctx, in, (size_t) n, BCJOutput_buffer(&out));
+        }
+        err = BCJOutput_write(&out, outLen);
+        *written += outLen;
+        if (n == 0) {
+            break;
+        }
+    }
+    if (ctx != NULL) {
+        BCJ_ContextDestroy(ctx);
+    }
+    BCJOutput_free(&out);
+    BCJ_ALIGNED_FREE(in);
+    return err;
+}
+
+int
+main(int argc, char **argv) {
+    BCJOptions opts = {BCJ_ARCH_X86, BCJ_ENCODE, 0, 1, BCJ_PIPE_BLOCK_SIZE_DEFAULT, 0, 0};
+    uint64_t written = 0;
+    double start;
+    int err;
+
+    err = BCJCli_parse(argc, argv, &opts);
+    if (err >= 0) {
+        return err;
+    }
+#ifdef _WIN32
+    _setmode(0, _O_BINARY);
+    _setmode(1, _O_BINARY);
+#endif
+    start = BCJCli_now();
+    if (opts.threads > 1) {
+        // the conversion itself is sequential: addresses depend on the stream position
+        UInt64 pipeWritten = 0;
+        unsigned blocks = opts.threads > BCJ_PIPE_BLOCKS_DEFAULT ? opts.threads : BCJ_PIPE_BLOCKS_DEFAULT;
+        err = BCJ_Pipe(0, 1, opts.arch, opts.encoding, opts.startOffset, 0, opts.blockSize, blocks,
+                       &pipeWritten);
+        written = pipeWritten;
+    } else {
+        err = BCJCli_filter(0, 1, &opts, &written);
+    }
+    if (err != 0) {
+        BCJCli_error("filtering failed", err);
+        return 1;
+    }
+    if (opts.stats) {
+        double elapsed = BCJCli_now() - start;
+        fprintf(stderr, "bcj: %s %s: %llu bytes in %.3f s, %.1f MiB/s\n", archNames[opts.arch],
+                opts.encoding ? "encode" : "decode", (unsigned long long) written, elapsed,
+                elapsed > 0 ? (double) written / elapsed / (1 << 20) : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * PyBcj library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#include <stdlib.h>
+
+#include "Arena.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+static SRWLOCK arenaLock = SRWLOCK_INIT;
+#define ARENA_LOCK() AcquireSRWLockExclusive(&arenaLock)
+#define ARENA_UNLOCK() ReleaseSRWLockExclusive(&arenaLock)
+#define ARENA_FREE(p) _aligned_free(p)
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+static pthread_mutex_t arenaLock = PTHREAD_MUTEX_INITIALIZER;
+#define ARENA_LOCK() pthread_mutex_lock(&arenaLock)
+#define ARENA_UNLOCK() pthread_mutex_unlock(&arenaLock)
+#define ARENA_FREE(p) free(p)
+#endif
+
+/* Size classes are powers of two from BCJ_ARENA_LINE to BCJ_ARENA_CACHE_BLOCK_MAX. */
+#define ARENA_MIN_SHIFT 6
+#define ARENA_MAX_SHIFT 26
+#define ARENA_CLASSES (ARENA_MAX_SHIFT - ARENA_MIN_SHIFT + 1)
+
+typedef char ArenaShiftsMatch[((SizeT) 1 << ARENA_MIN_SHIFT) == BCJ_ARENA_LINE &&
+                              ((SizeT) 1 << ARENA_MAX_SHIFT) == BCJ_ARENA_CACHE_BLOCK_MAX ? 1 : -1];
+
+/* Freed blocks of each class, linked through their first bytes. */
+static void *freeList[ARENA_CLASSES];
+static SizeT cachedSize;
+
+static void *
+BCJArena_system_alloc(SizeT size) {
+    SizeT align = size >= BCJ_ARENA_HUGE ? BCJ_ARENA_HUGE : size >= BCJ_ARENA_PAGE ? BCJ_ARENA_PAGE : BCJ_ARENA_LINE;
+    void *p;
+
+#ifdef _WIN32
+    p = _aligned_malloc(size, align);
+#else
+    if (posix_memalign(&p, align, size) != 0) {
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (size >= BCJ_ARENA_HUGE) {
+        // only a hint; kernels without transparent huge pages refuse it
+        madvise(p, size, MADV_HUGEPAGE);
+    }
+#endif
+#endif
+    return p;
+}
+
+void *
+BCJArena_alloc(SizeT size, SizeT *allocated) {
+    SizeT blockSize;
+    void *p = NULL;
+
+    if (size <= BCJ_ARENA_CACHE_BLOCK_MAX) {
+        unsigned shift = ARENA_MIN_SHIFT;
+        while (((SizeT) 1 << shift) < size) {
+            shift++;
+        }
+        blockSize = (SizeT) 1 << shift;
+        ARENA_LOCK();
+        p = freeList[shift - ARENA_MIN_SHIFT];
+        if (p != NULL) {
+            freeList[shift - ARENA_MIN_SHIFT] = *(void **) p;
+            cachedSize -= blockSize;
+        }
+        ARENA_UNLOCK();
+    } else {
+        if (size > (SizeT) -1 - BCJ_ARENA_HUGE) {
+            return NULL;
+        }
+        blockSize = (size + BCJ_ARENA_HUGE - 1) & ~(BCJ_ARENA_HUGE - 1);
+    }
+    if (p == NULL) {
+        p = BCJArena_system_alloc(blockSize);
+        if (p == NULL) {
+            return NULL;
+        }
+    }
+    *allocated = blockSize;
+    return p;
+}
+
+void
+BCJArena_free(void *p, SizeT allocated) {
+    if (p == NULL) {
+        return;
+    }
+    if (allocated <= BCJ_ARENA_CACHE_BLOCK_MAX) {
+        unsigned shift = ARENA_MIN_SHIFT;
+        while (((SizeT) 1 << shift) < allocated) {
+            shift++;
+        }
+        ARENA_LOCK();
+        if (cachedSize + allocated <= BCJ_ARENA_CACHE_MAX) {
+            *(void **) p = freeList[shift - ARENA_MIN_SHIFT];
+            freeList[shift - ARENA_MIN_SHIFT] = p;
+            cachedSize += allocated;
+            p = NULL;
+        }
+        ARENA_UNLOCK();
+    }
+    if (p != NULL) {
+        ARENA_FREE(p);
+    }
+}
+
+void
+BCJArena_trim(void) {
+    void *blocks[ARENA_CLASSES];
+
+    ARENA_LOCK();
+    for (unsigned i = 0; i < ARENA_CLASSES; i++) {
+        blocks[i] = freeList[i];
+        freeList[i] = NULL;
+    }
+    cachedSize = 0;
+    ARENA_UNLOCK();
+    for (unsigned i = 0; i < ARENA_CLASSES; i++) {
+        while (blocks[i] != NULL) {
+            void *next = *(void **) blocks[i];
+            ARENA_FREE(blocks[i]);
+            blocks[i] = next;
+        }
+    }
+}
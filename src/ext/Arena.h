@@ -0,0 +1,45 @@
+/**
+ * PyBcj library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef BCJ_ARENA_H
+#define BCJ_ARENA_H
+
+#include "Arch.h"
+
+EXTERN_C_BEGIN
+
+/* Alignment of small blocks, a cache line */
+#define BCJ_ARENA_LINE 64
+/* Blocks from this size are aligned to a page */
+#define BCJ_ARENA_PAGE 4096
+/* Blocks from this size are aligned to and advised for transparent huge pages */
+#define BCJ_ARENA_HUGE ((SizeT) 2 << 20)
+/* Blocks up to this size are kept in the free list when they are freed */
+#define BCJ_ARENA_CACHE_BLOCK_MAX ((SizeT) 64 << 20)
+/* Total size of the blocks in the free list at most */
+#define BCJ_ARENA_CACHE_MAX ((SizeT) 128 << 20)
+
+/*
+Working buffers of the filter objects.
+
+Sizes are rounded up to a power of two, so a growing buffer is reallocated only
+a logarithmic number of times, and freed blocks are kept in a process-wide free
+list for each size to be reused by any filter object. The free list is guarded by
+a mutex, and can be used from any thread and interpreter.
+
+BCJArena_alloc returns a block of at least size bytes, or NULL when out of memory,
+and sets *allocated to the usable size that should be given to BCJArena_free.
+*/
+void *BCJArena_alloc(SizeT size, SizeT *allocated);
+
+/* Return a block to the free list, or to the system when the list is full. p may be NULL. */
+void BCJArena_free(void *p, SizeT allocated);
+
+/* Release all blocks in the free list to the system. */
+void BCJArena_trim(void);
+
+EXTERN_C_END
+
+#endif
@@ -1,7 +1,10 @@
 /* Bra.c -- Converters for RISC code
 2017-04-04 : Igor Pavlov : Public domain */
 
+#include <string.h>
+
 #include "Bra.h"
+#include "BraSwar.h"
 
 SizeT ARM_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
 {
@@ -16,6 +19,7 @@ SizeT ARM_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
 
   for (;;)
   {
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARM)
     for (;;)
     {
       if (p >= lim)
@@ -37,6 +41,7 @@ SizeT ARM_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
 
   for (;;)
   {
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARM)
     for (;;)
     {
       if (p >= lim)
@@ -71,6 +76,7 @@ SizeT ARMT_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
   for (;;)
   {
     UInt32 b1;
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARMT)
     for (;;)
     {
       UInt32 b3;
@@ -106,6 +112,7 @@ SizeT ARMT_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
   for (;;)
   {
     UInt32 b1;
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARMT)
     for (;;)
     {
       UInt32 b3;
@@ -225,3 +232,363 @@ SizeT SPARC_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
     }
   }
 }
+
+
+/*
+ARM64 converts BL and ADRP as the ARM64 filter of xz 5.4 and later does. BL has a 26-bit
+offset in words. ADRP has a 21-bit offset in 4 KiB pages, and only the ones within +-512 MiB
+are converted, with bits 17 to 20 of the result made a sign extension of bit 17, so the
+decoder can tell them apart again. pc is the position of the instruction itself.
+*/
+
+#define ARM64_IS_BL(v) (((v) >> 26) == 0x25)
+#define ARM64_IS_ADRP(v) (((v) & 0x9F000000) == 0x90000000)
+/* page offset of ADRP, immlo (bits 29 and 30) then immhi (bits 5 to 23) */
+#define ARM64_ADRP_OFFSET(v) ((((v) >> 29) & 3) | (((v) >> 3) & 0x001FFFFC))
+#define ARM64_ADRP_IN_RANGE(src) ((((src) + 0x00020000) & 0x001C0000) == 0)
+
+static UInt32 ARM64_ConvertInstr(UInt32 v, UInt32 pc, int encoding)
+{
+  if (ARM64_IS_BL(v))
+  {
+    pc >>= 2;
+    if (!encoding)
+      pc = 0 - pc;
+    return 0x94000000 | ((v + pc) & 0x03FFFFFF);
+  }
+  {
+    UInt32 dest;
+    pc >>= 12;
+    if (!encoding)
+      pc = 0 - pc;
+    dest = ARM64_ADRP_OFFSET(v) + pc;
+    v &= 0x9000001F;
+    v |= (dest & 3) << 29;
+    v |= (dest & 0x0003FFFC) << 3;
+    v |= (0 - (dest & 0x00020000)) & 0x00E00000;
+    return v;
+  }
+}
+
+/* nonzero for the instructions ARM64_Convert changes */
+#define ARM64_IS_BRANCH(v) (ARM64_IS_BL(v) || (ARM64_IS_ADRP(v) && ARM64_ADRP_IN_RANGE(ARM64_ADRP_OFFSET(v))))
+
+SizeT ARM64_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
+{
+  Byte *p;
+  const Byte *lim;
+  size &= ~(size_t)3;
+  p = data;
+  lim = data + size;
+
+  for (;;)
+  {
+    UInt32 v;
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARM64)
+    for (;;)
+    {
+      if (p >= lim)
+        return p - data;
+      v = GetUi32(p);
+      p += 4;
+      if (ARM64_IS_BRANCH(v))
+        break;
+    }
+    v = ARM64_ConvertInstr(v, ip + (UInt32)(p - 4 - data), encoding);
+    SetUi32(p - 4, v);
+  }
+}
+
+
+SizeT ARM_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding)
+{
+  const Byte *p;
+  const Byte *lim;
+  const Byte *run;
+  size &= ~(size_t)3;
+  ip += 4;
+  p = src;
+  run = src;
+  lim = src + size;
+
+  for (;;)
+  {
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARM)
+    for (;;)
+    {
+      if (p >= lim)
+      {
+        memcpy(dest + (run - src), run, (size_t)(p - run));
+        return p - src;
+      }
+      p += 4;
+      if (p[-1] == 0xEB)
+        break;
+    }
+    {
+      UInt32 v = GetUi32(p - 4);
+      v <<= 2;
+      if (encoding)
+        v += ip + (UInt32)(p - src);
+      else
+        v -= ip + (UInt32)(p - src);
+      v >>= 2;
+      v &= 0x00FFFFFF;
+      v |= 0xEB000000;
+      memcpy(dest + (run - src), run, (size_t)(p - 4 - run));
+      SetUi32(dest + (p - 4 - src), v);
+      run = p;
+    }
+  }
+}
+
+
+SizeT ARMT_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding)
+{
+  const Byte *p;
+  const Byte *lim;
+  const Byte *run;
+  size &= ~(size_t)1;
+  p = src;
+  run = src;
+  lim = src + size - 4;
+
+  for (;;)
+  {
+    UInt32 b1;
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARMT)
+    for (;;)
+    {
+      UInt32 b3;
+      if (p > lim)
+      {
+        memcpy(dest + (run - src), run, (size_t)(p - run));
+        return p - src;
+      }
+      b1 = p[1];
+      b3 = p[3];
+      p += 2;
+      b1 ^= 8;
+      if ((b3 & b1) >= 0xF8)
+        break;
+    }
+    {
+      Byte *d;
+      UInt32 v =
+             ((UInt32)b1 << 19)
+          + (((UInt32)p[1] & 0x7) << 8)
+          + (((UInt32)p[-2] << 11))
+          + (p[0]);
+
+      p += 2;
+      {
+        UInt32 cur = (ip + (UInt32)(p - src)) >> 1;
+        if (encoding)
+          v += cur;
+        else
+          v -= cur;
+      }
+
+      memcpy(dest + (run - src), run, (size_t)(p - 4 - run));
+      d = dest + (p - src);
+      d[-4] = (Byte)(v >> 11);
+      d[-3] = (Byte)(0xF0 | ((v >> 19) & 0x7));
+      d[-2] = (Byte)v;
+      d[-1] = (Byte)(0xF8 | (v >> 8));
+      run = p;
+    }
+  }
+}
+
+
+SizeT PPC_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding)
+{
+  const Byte *p;
+  const Byte *lim;
+  const Byte *run;
+  size &= ~(size_t)3;
+  ip -= 4;
+  p = src;
+  run = src;
+  lim = src + size;
+
+  for (;;)
+  {
+    for (;;)
+    {
+      if (p >= lim)
+      {
+        memcpy(dest + (run - src), run, (size_t)(p - run));
+        return p - src;
+      }
+      p += 4;
+      /* if ((v & 0xFC000003) == 0x48000001) */
+      if ((p[-4] & 0xFC) == 0x48 && (p[-1] & 3) == 1)
+        break;
+    }
+    {
+      UInt32 v = GetBe32(p - 4);
+      if (encoding)
+        v += ip + (UInt32)(p - src);
+      else
+        v -= ip + (UInt32)(p - src);
+      v &= 0x03FFFFFF;
+      v |= 0x48000000;
+      memcpy(dest + (run - src), run, (size_t)(p - 4 - run));
+      SetBe32(dest + (p - 4 - src), v);
+      run = p;
+    }
+  }
+}
+
+
+SizeT SPARC_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding)
+{
+  const Byte *p;
+  const Byte *lim;
+  const Byte *run;
+  size &= ~(size_t)3;
+  ip -= 4;
+  p = src;
+  run = src;
+  lim = src + size;
+
+  for (;;)
+  {
+    for (;;)
+    {
+      if (p >= lim)
+      {
+        memcpy(dest + (run - src), run, (size_t)(p - run));
+        return p - src;
+      }
+      p += 4;
+      if ((p[-4] == 0x40 && (p[-3] & 0xC0) == 0) ||
+          (p[-4] == 0x7F && (p[-3] >= 0xC0)))
+        break;
+    }
+    {
+      UInt32 v = GetBe32(p - 4);
+      v <<= 2;
+      if (encoding)
+        v += ip + (UInt32)(p - src);
+      else
+        v -= ip + (UInt32)(p - src);
+
+      v &= 0x01FFFFFF;
+      v -= (UInt32)1 << 24;
+      v ^= 0xFF000000;
+      v >>= 2;
+      v |= 0x40000000;
+      memcpy(dest + (run - src), run, (size_t)(p - 4 - run));
+      SetBe32(dest + (p - 4 - src), v);
+      run = p;
+    }
+  }
+}
+
+
+SizeT ARM64_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding)
+{
+  const Byte *p;
+  const Byte *lim;
+  const Byte *run;
+  size &= ~(size_t)3;
+  p = src;
+  run = src;
+  lim = src + size;
+
+  for (;;)
+  {
+    UInt32 v;
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARM64)
+    for (;;)
+    {
+      if (p >= lim)
+      {
+        memcpy(dest + (run - src), run, (size_t)(p - run));
+        return p - src;
+      }
+      v = GetUi32(p);
+      p += 4;
+      if (ARM64_IS_BRANCH(v))
+        break;
+    }
+    v = ARM64_ConvertInstr(v, ip + (UInt32)(p - 4 - src), encoding);
+    memcpy(dest + (run - src), run, (size_t)(p - 4 - run));
+    SetUi32(dest + (p - 4 - src), v);
+    run = p;
+  }
+}
+
+
+SizeT ARM_Scan(const Byte *data, SizeT size)
+{
+  const Byte *p = data;
+  const Byte *lim = data + (size & ~(size_t)3);
+  BRA_SWAR_SKIP(p, lim, BraSwar_ARM)
+  for (; p < lim; p += 4)
+    if (p[3] == 0xEB)
+      break;
+  return p - data;
+}
+
+
+SizeT ARMT_Scan(const Byte *data, SizeT size)
+{
+  const Byte *p = data;
+  const Byte *lim;
+  size &= ~(size_t)1;
+  if (size == 0)
+    return 0;
+  if (size >= 4)
+  {
+    lim = data + size - 4;
+    BRA_SWAR_SKIP(p, lim, BraSwar_ARMT)
+    for (; p <= lim; p += 2)
+      if ((p[3] & (p[1] ^ 8)) >= 0xF8)
+        return p - data;
+  }
+  /* the last halfword starts a BL only if its high byte is F0..F7; the second half comes later */
+  if ((p[1] & 0xF8) == 0xF0)
+    return p - data;
+  return size;
+}
+
+
+SizeT PPC_Scan(const Byte *data, SizeT size)
+{
+  const Byte *p = data;
+  const Byte *lim = data + (size & ~(size_t)3);
+  for (; p < lim; p += 4)
+    if ((p[0] & 0xFC) == 0x48 && (p[3] & 3) == 1)
+      break;
+  return p - data;
+}
+
+
+SizeT SPARC_Scan(const Byte *data, SizeT size)
+{
+  const Byte *p = data;
+  const Byte *lim = data + (size & ~(size_t)3);
+  for (; p < lim; p += 4)
+    if ((p[0] == 0x40 && (p[1] & 0xC0) == 0) ||
+        (p[0] == 0x7F && (p[1] >= 0xC0)))
+      break;
+  return p - data;
+}
+
+
+SizeT ARM64_Scan(const Byte *data, SizeT size)
+{
+  const Byte *p = data;
+  const Byte *lim = data + (size & ~(size_t)3);
+  BRA_SWAR_SKIP(p, lim, BraSwar_ARM64)
+  for (; p < lim; p += 4)
+  {
+    UInt32 v = GetUi32(p);
+    if (ARM64_IS_BRANCH(v))
+      break;
+  }
+  return p - data;
+}
@@ -31,6 +31,7 @@ in CALL instructions to increase the compression ratio.
   x86    little      1          4
   ARMT   little      2          2
   ARM    little      4          0
+  ARM64  little      4          0
   PPC     big        4          0
   SPARC   big        4          0
   IA64   little     16          0
@@ -55,10 +56,56 @@ in CALL instructions to increase the compression ratio.
 SizeT x86_Convert(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding);
 SizeT ARM_Convert(Byte *data, SizeT size, UInt32 ip, int encoding);
 SizeT ARMT_Convert(Byte *data, SizeT size, UInt32 ip, int encoding);
+SizeT ARM64_Convert(Byte *data, SizeT size, UInt32 ip, int encoding);
 SizeT PPC_Convert(Byte *data, SizeT size, UInt32 ip, int encoding);
 SizeT SPARC_Convert(Byte *data, SizeT size, UInt32 ip, int encoding);
 SizeT IA64_Convert(Byte *data, SizeT size, UInt32 ip, int encoding);
 
+/*
+The *_Convert_Copy functions are the same converters, but they read from src
+and write converted bytes to dest in a single pass instead of converting in place.
+src and dest must not overlap. Only the first (returned value) bytes of dest are written.
+*/
+
+SizeT x86_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, UInt32 *state, int encoding);
+SizeT ARM_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding);
+SizeT ARMT_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding);
+SizeT ARM64_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding);
+SizeT PPC_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding);
+SizeT SPARC_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding);
+SizeT IA64_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding);
+
+/*
+On x86-64 with AVX-512 (F, BW and VBMI2), x86_Convert and x86_Convert_Copy dispatch at run time
+to x86_Convert_Avx512 and x86_Convert_Copy_Avx512, which give the same result. Those can also be
+called directly when x86_Avx512Supported() returns nonzero.
+*/
+
+#if defined(MY_CPU_AMD64) && ((defined(__clang__) && __clang_major__ >= 8) \
+    || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8) || (defined(_MSC_VER) && _MSC_VER >= 1920))
+#define BRA_X86_AVX512
+int x86_Avx512Supported(void);
+SizeT x86_Convert_Avx512(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding);
+SizeT x86_Convert_Copy_Avx512(const Byte *src, Byte *dest, SizeT size, UInt32 ip, UInt32 *state, int encoding);
+#endif
+
+/*
+The *_Scan functions look for the first branch instruction the converter may change.
+They return the number of leading bytes that the converter passes over unchanged,
+so the caller can copy them through and continue converting from that point.
+Unlike the converters, they also test the bytes of the lookahead at the end of data, and
+return size when none of them can start a branch, so such data need not be carried over.
+x86_Scan also updates state as x86_Convert does.
+*/
+
+SizeT x86_Scan(const Byte *data, SizeT size, UInt32 *state);
+SizeT ARM_Scan(const Byte *data, SizeT size);
+SizeT ARMT_Scan(const Byte *data, SizeT size);
+SizeT ARM64_Scan(const Byte *data, SizeT size);
+SizeT PPC_Scan(const Byte *data, SizeT size);
+SizeT SPARC_Scan(const Byte *data, SizeT size);
+SizeT IA64_Scan(const Byte *data, SizeT size);
+
 EXTERN_C_END
 
 #endif
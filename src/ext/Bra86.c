@@ -1,14 +1,34 @@
 /* Bra86.c -- Converter for x86 code (BCJ)
 2017-04-03 : Igor Pavlov : Public domain */
 
+#include <string.h>
+
 #include "Bra.h"
+#include "BraSwar.h"
 
 #define Test86MSByte(b) ((((b) + 1) & 0xFE) == 0)
 
+#ifdef BRA_X86_AVX512
+/* -1 until the CPU is checked on the first call; threads racing on it store the same value */
+static volatile int x86_UseAvx512 = -1;
+
+static int x86_Avx512(void)
+{
+  int use = x86_UseAvx512;
+  if (use < 0)
+    x86_UseAvx512 = use = x86_Avx512Supported();
+  return use;
+}
+#endif
+
 SizeT x86_Convert(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding)
 {
   SizeT pos = 0;
   UInt32 mask = *state & 7;
+#ifdef BRA_X86_AVX512
+  if (x86_Avx512())
+    return x86_Convert_Avx512(data, size, ip, state, encoding);
+#endif
   if (size < 5)
     return 0;
   size -= 4;
@@ -18,6 +38,7 @@ SizeT x86_Convert(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding
   {
     Byte *p = data + pos;
     const Byte *limit = data + size;
+    BRA_SWAR_SKIP(p, limit, BraSwar_x86)
     for (; p < limit; p++)
       if ((*p & 0xFE) == 0xE8)
         break;
@@ -78,3 +99,107 @@ SizeT x86_Convert(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding
     }
   }
 }
+
+SizeT x86_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, UInt32 *state, int encoding)
+{
+  SizeT pos = 0;
+  SizeT copied = 0;
+  UInt32 mask = *state & 7;
+#ifdef BRA_X86_AVX512
+  if (x86_Avx512())
+    return x86_Convert_Copy_Avx512(src, dest, size, ip, state, encoding);
+#endif
+  if (size < 5)
+    return 0;
+  size -= 4;
+  ip += 5;
+
+  for (;;)
+  {
+    const Byte *p = src + pos;
+    const Byte *limit = src + size;
+    BRA_SWAR_SKIP(p, limit, BraSwar_x86)
+    for (; p < limit; p++)
+      if ((*p & 0xFE) == 0xE8)
+        break;
+
+    {
+      SizeT d = (SizeT)(p - src - pos);
+      pos = (SizeT)(p - src);
+      if (p >= limit)
+      {
+        *state = (d > 2 ? 0 : mask >> (unsigned)d);
+        memcpy(dest + copied, src + copied, pos - copied);
+        return pos;
+      }
+      if (d > 2)
+        mask = 0;
+      else
+      {
+        mask >>= (unsigned)d;
+        if (mask != 0 && (mask > 4 || mask == 3 || Test86MSByte(p[(size_t)(mask >> 1) + 1])))
+        {
+          mask = (mask >> 1) | 4;
+          pos++;
+          continue;
+        }
+      }
+    }
+
+    if (Test86MSByte(p[4]))
+    {
+      Byte *q;
+      UInt32 v = ((UInt32)p[4] << 24) | ((UInt32)p[3] << 16) | ((UInt32)p[2] << 8) | ((UInt32)p[1]);
+      UInt32 cur = ip + (UInt32)pos;
+      if (encoding)
+        v += cur;
+      else
+        v -= cur;
+      if (mask != 0)
+      {
+        unsigned sh = (mask & 6) << 2;
+        if (Test86MSByte((Byte)(v >> sh)))
+        {
+          v ^= (((UInt32)0x100 << sh) - 1);
+          if (encoding)
+            v += cur;
+          else
+            v -= cur;
+        }
+        mask = 0;
+      }
+      memcpy(dest + copied, src + copied, pos + 1 - copied);
+      q = dest + pos;
+      q[1] = (Byte)v;
+      q[2] = (Byte)(v >> 8);
+      q[3] = (Byte)(v >> 16);
+      q[4] = (Byte)(0 - ((v >> 24) & 1));
+      pos += 5;
+      copied = pos;
+    }
+    else
+    {
+      mask = (mask >> 1) | 4;
+      pos++;
+    }
+  }
+}
+
+/*
+x86_Scan looks at the last four bytes too: a candidate there must wait for more data,
+but when there is none, every byte of data passes unchanged whatever follows it.
+*/
+
+SizeT x86_Scan(const Byte *data, SizeT size, UInt32 *state)
+{
+  const Byte *p = data;
+  const Byte *limit = data + size;
+  SizeT pos;
+  BRA_SWAR_SKIP(p, limit, BraSwar_x86)
+  for (; p < limit; p++)
+    if ((*p & 0xFE) == 0xE8)
+      break;
+  pos = (SizeT)(p - data);
+  *state = (pos > 2 ? 0 : (*state & 7) >> (unsigned)pos);
+  return pos;
+}
@@ -0,0 +1,193 @@
+/* Bra86Avx512.c -- x86 converter with AVX-512 candidate extraction
+   SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <string.h>
+
+#include "Bra.h"
+
+#ifdef BRA_X86_AVX512
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BRA_AVX512_TARGET
+#else
+#include <cpuid.h>
+#define BRA_AVX512_TARGET __attribute__((target("avx512f,avx512bw,avx512vbmi2,popcnt")))
+#endif
+
+#define Test86MSByte(b) ((((b) + 1) & 0xFE) == 0)
+
+int x86_Avx512Supported(void)
+{
+  unsigned b, c, xcr0;
+#ifdef _MSC_VER
+  int r[4];
+  __cpuid(r, 0);
+  if (r[0] < 7)
+    return 0;
+  __cpuid(r, 1);
+  c = (unsigned)r[2];
+  if (!(c & (1u << 27)) || !(c & (1u << 23)))
+    return 0;
+  xcr0 = (unsigned)_xgetbv(0);
+  __cpuidex(r, 7, 0);
+  b = (unsigned)r[1];
+  c = (unsigned)r[2];
+#else
+  unsigned a, d;
+  if (__get_cpuid_max(0, NULL) < 7)
+    return 0;
+  __cpuid(1, a, b, c, d);
+  /* OSXSAVE and POPCNT */
+  if (!(c & (1u << 27)) || !(c & (1u << 23)))
+    return 0;
+  __asm__ __volatile__("xgetbv" : "=a"(xcr0), "=d"(d) : "c"(0));
+  __cpuid_count(7, 0, a, b, c, d);
+#endif
+  /* the OS saves the SSE, AVX and AVX-512 registers: XCR0 bits 1, 2, 5, 6 and 7 */
+  if ((xcr0 & 0xE6) != 0xE6)
+    return 0;
+  /* AVX512F, AVX512BW and AVX512_VBMI2 */
+  return (b & (1u << 16)) && (b & (1u << 30)) && (c & (1u << 6));
+}
+
+static const Byte x86_Avx512Iota[64] = {
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+  16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+  32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+  48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63
+};
+
+/*
+x86_Convert_Copy, with the positions of E8/E9 bytes taken 64 bytes at a time: vpcmpeqb gives
+a mask of the candidates in a block and vpcompressb packs their offsets into a queue that feeds
+the state machine, so dense regions take several candidates from one block. The queue is read
+lazily, and candidates passed over by a conversion are dropped from it. Converts in place when
+src == dest.
+*/
+BRA_AVX512_TARGET
+static SizeT x86_Avx512(const Byte *src, Byte *dest, SizeT size, UInt32 ip, UInt32 *state, int encoding)
+{
+  Byte offsets[64];
+  unsigned count = 0, next = 0;
+  SizeT base = 0, scanned = 0;
+  SizeT pos = 0;
+  SizeT copied = 0;
+  UInt32 mask = *state & 7;
+  const __m512i iota = _mm512_loadu_si512((const void *)x86_Avx512Iota);
+  const __m512i fe = _mm512_set1_epi8((char)0xFE);
+  const __m512i e8 = _mm512_set1_epi8((char)0xE8);
+  if (size < 5)
+    return 0;
+  size -= 4;
+  ip += 5;
+
+  for (;;)
+  {
+    const Byte *p;
+    /* without a candidate, where the scan stops; a conversion may have passed the end */
+    SizeT c = pos > size ? pos : size;
+    for (;;)
+    {
+      while (next < count && base + offsets[next] < pos)
+        next++;
+      if (next < count)
+      {
+        c = base + offsets[next++];
+        break;
+      }
+      if (scanned < pos)
+        scanned = pos;
+      if (scanned >= size)
+        break;
+      {
+        SizeT len = size - scanned < 64 ? size - scanned : 64;
+        __mmask64 live = _cvtu64_mask64(len == 64 ? ~(UInt64)0 : ((UInt64)1 << len) - 1);
+        __m512i v = _mm512_maskz_loadu_epi8(live, src + scanned);
+        __mmask64 m = _mm512_mask_cmpeq_epi8_mask(live, _mm512_and_si512(v, fe), e8);
+        base = scanned;
+        scanned += len;
+        next = 0;
+        count = (unsigned)_mm_popcnt_u64(_cvtmask64_u64(m));
+        if (count != 0)
+          _mm512_storeu_si512((void *)offsets, _mm512_maskz_compress_epi8(m, iota));
+      }
+    }
+
+    p = src + c;
+    {
+      SizeT d = c - pos;
+      pos = c;
+      if (c >= size)
+      {
+        *state = (d > 2 ? 0 : mask >> (unsigned)d);
+        if (dest != src)
+          memcpy(dest + copied, src + copied, pos - copied);
+        return pos;
+      }
+      if (d > 2)
+        mask = 0;
+      else
+      {
+        mask >>= (unsigned)d;
+        if (mask != 0 && (mask > 4 || mask == 3 || Test86MSByte(p[(size_t)(mask >> 1) + 1])))
+        {
+          mask = (mask >> 1) | 4;
+          pos++;
+          continue;
+        }
+      }
+    }
+
+    if (Test86MSByte(p[4]))
+    {
+      Byte *q;
+      UInt32 v = ((UInt32)p[4] << 24) | ((UInt32)p[3] << 16) | ((UInt32)p[2] << 8) | ((UInt32)p[1]);
+      UInt32 cur = ip + (UInt32)pos;
+      if (encoding)
+        v += cur;
+      else
+        v -= cur;
+      if (mask != 0)
+      {
+        unsigned sh = (mask & 6) << 2;
+        if (Test86MSByte((Byte)(v >> sh)))
+        {
+          v ^= (((UInt32)0x100 << sh) - 1);
+          if (encoding)
+            v += cur;
+          else
+            v -= cur;
+        }
+        mask = 0;
+      }
+      if (dest != src)
+        memcpy(dest + copied, src + copied, pos + 1 - copied);
+      q = dest + pos;
+      q[1] = (Byte)v;
+      q[2] = (Byte)(v >> 8);
+      q[3] = (Byte)(v >> 16);
+      q[4] = (Byte)(0 - ((v >> 24) & 1));
+      pos += 5;
+      copied = pos;
+    }
+    else
+    {
+      mask = (mask >> 1) | 4;
+      pos++;
+    }
+  }
+}
+
+SizeT x86_Convert_Avx512(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding)
+{
+  return x86_Avx512(data, data, size, ip, state, encoding);
+}
+
+SizeT x86_Convert_Copy_Avx512(const Byte *src, Byte *dest, SizeT size, UInt32 ip, UInt32 *state, int encoding)
+{
+  return x86_Avx512(src, dest, size, ip, state, encoding);
+}
+
+#endif
@@ -1,6 +1,8 @@
 /* BraIA64.c -- Converter for IA-64 code
 2017-01-26 : Igor Pavlov : Public domain */
 
+#include <string.h>
+
 #include "Bra.h"
 
 SizeT IA64_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
@@ -48,3 +50,69 @@ SizeT IA64_Convert(Byte *data, SizeT size, UInt32 ip, int encoding)
   while (i <= size);
   return i;
 }
+
+SizeT IA64_Convert_Copy(const Byte *src, Byte *dest, SizeT size, UInt32 ip, int encoding)
+{
+  SizeT i;
+  if (size < 16)
+    return 0;
+  size -= 16;
+  i = 0;
+  do
+  {
+    /* slots of a bundle overlap, so convert a copied bundle in place */
+    Byte *data = dest + i;
+    unsigned m = ((UInt32)0x334B0000 >> (src[i] & 0x1E)) & 3;
+    memcpy(data, src + i, 16);
+    if (m)
+    {
+      m++;
+      do
+      {
+        Byte *p = data + ((size_t)m * 5 - 8);
+        if (((p[3] >> m) & 15) == 5
+            && (((p[-1] | ((UInt32)p[0] << 8)) >> m) & 0x70) == 0)
+        {
+          unsigned raw = GetUi32(p);
+          unsigned v = raw >> m;
+          v = (v & 0xFFFFF) | ((v & (1 << 23)) >> 3);
+
+          v <<= 4;
+          if (encoding)
+            v += ip + (UInt32)i;
+          else
+            v -= ip + (UInt32)i;
+          v >>= 4;
+
+          v &= 0x1FFFFF;
+          v += 0x700000;
+          v &= 0x8FFFFF;
+          raw &= ~((UInt32)0x8FFFFF << m);
+          raw |= (v << m);
+          SetUi32(p, raw);
+        }
+      }
+      while (++m <= 4);
+    }
+    i += 16;
+  }
+  while (i <= size);
+  return i;
+}
+
+SizeT IA64_Scan(const Byte *data, SizeT size)
+{
+  SizeT i;
+  if (size < 16)
+    return 0;
+  size -= 16;
+  i = 0;
+  do
+  {
+    if (((UInt32)0x334B0000 >> (data[i] & 0x1E)) & 3)
+      break;
+    i += 16;
+  }
+  while (i <= size);
+  return i;
+}
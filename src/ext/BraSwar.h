@@ -0,0 +1,53 @@
+/* BraSwar.h -- Candidate tests of the branch converters on eight bytes at a time
+   SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#ifndef __BRA_SWAR_H
+#define __BRA_SWAR_H
+
+#include "Arch.h"
+
+/*
+Each BraSwar_* macro takes eight bytes loaded with GetUi64(), and is zero when none of the
+positions a converter steps through in them starts an instruction it may change. They work
+within a 64-bit integer register (SWAR), so every host gets them, with or without SIMD.
+
+The tests are exact for the positions whose bytes are all in the word and conservative
+for the others, so the converters skip words while a test is zero and leave the rest to
+their byte-by-byte loops.
+
+  x86    any byte that is E8 or E9
+  ARM    bytes 3 and 7 are EB                        (BL at offsets 0 and 4)
+  ARMT   bytes 1, 3, 5 are F0..F7 followed two bytes later by F8..FF, or byte 7 is F0..F7
+  ARM64  bytes 3 and 7 are 94..97 (BL) or have the bits of ADRP, 1xx10000 (range not tested)
+
+PPC and SPARC have none: their loops already look at one or two bytes of each four-byte
+instruction, and a word test of two instructions costs more than that.
+*/
+
+#define BRA_SWAR_BYTES(b) ((UInt64)(b) * UINT64_CONST(0x0101010101010101))
+
+/* bit 7 of each byte that is zero, and no other bit */
+#define BRA_SWAR_ZERO(y) \
+  (~((((y) & BRA_SWAR_BYTES(0x7F)) + BRA_SWAR_BYTES(0x7F)) | (y)) & BRA_SWAR_BYTES(0x80))
+
+/* bit 7 of each byte that equals b after masking with m */
+#define BRA_SWAR_MATCH(w, m, b) BRA_SWAR_ZERO(((w) & BRA_SWAR_BYTES(m)) ^ BRA_SWAR_BYTES(b))
+
+#define BraSwar_x86(w) BRA_SWAR_MATCH(w, 0xFE, 0xE8)
+
+#define BraSwar_ARM(w) (BRA_SWAR_MATCH(w, 0xFF, 0xEB) & UINT64_CONST(0x8000000080000000))
+
+#define BraSwar_ARMT(w) \
+  (BRA_SWAR_MATCH(w, 0xF8, 0xF0) \
+    & ((BRA_SWAR_MATCH(w, 0xF8, 0xF8) >> 16) | UINT64_CONST(0x8000000000000000)) \
+    & UINT64_CONST(0x8000800080008000))
+
+#define BraSwar_ARM64(w) \
+  ((BRA_SWAR_MATCH(w, 0xFC, 0x94) | BRA_SWAR_MATCH(w, 0x9F, 0x90)) & UINT64_CONST(0x8000000080000000))
+
+/* Advance p by eight bytes while the test finds no candidate and p + 8 <= lim. */
+#define BRA_SWAR_SKIP(p, lim, test) \
+  while ((lim) - (p) >= 8 && test(GetUi64(p)) == 0) \
+    (p) += 8;
+
+#endif
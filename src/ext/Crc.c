@@ -0,0 +1,123 @@
+/**
+ * PyBcj library.
+ * CRC32 (zlib/7z) and CRC64 (xz, ECMA-182) calculation.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#include "Crc.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define kCrcPoly 0xEDB88320
+#define kCrc64Poly UINT64_CONST(0xC96C5795D7870F42)
+
+#define CRC_NUM_TABLES 8
+
+static UInt32 g_CrcTable[CRC_NUM_TABLES][256];
+static UInt64 g_Crc64Table[CRC_NUM_TABLES][256];
+
+static void CrcBuildTables(void)
+{
+  UInt32 i;
+  unsigned k;
+  for (i = 0; i < 256; i++)
+  {
+    UInt32 r = i;
+    UInt64 r64 = i;
+    unsigned j;
+    for (j = 0; j < 8; j++)
+    {
+      r = (r >> 1) ^ (kCrcPoly & ((UInt32)0 - (r & 1)));
+      r64 = (r64 >> 1) ^ (kCrc64Poly & ((UInt64)0 - (r64 & 1)));
+    }
+    g_CrcTable[0][i] = r;
+    g_Crc64Table[0][i] = r64;
+  }
+  for (k = 1; k < CRC_NUM_TABLES; k++)
+    for (i = 0; i < 256; i++)
+    {
+      UInt32 r = g_CrcTable[k - 1][i];
+      UInt64 r64 = g_Crc64Table[k - 1][i];
+      g_CrcTable[k][i] = g_CrcTable[0][r & 0xFF] ^ (r >> 8);
+      g_Crc64Table[k][i] = g_Crc64Table[0][r64 & 0xFF] ^ (r64 >> 8);
+    }
+}
+
+/* Tables are shared by all interpreters and threads, so they are written only once. */
+#ifdef _WIN32
+static INIT_ONCE g_CrcOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK CrcBuildTablesOnce(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+  (void)once;
+  (void)param;
+  (void)context;
+  CrcBuildTables();
+  return TRUE;
+}
+
+void CrcGenerateTable(void)
+{
+  InitOnceExecuteOnce(&g_CrcOnce, CrcBuildTablesOnce, NULL, NULL);
+}
+#else
+static pthread_once_t g_CrcOnce = PTHREAD_ONCE_INIT;
+
+void CrcGenerateTable(void)
+{
+  pthread_once(&g_CrcOnce, CrcBuildTables);
+}
+#endif
+
+#define CRC_UPDATE_BYTE(crc, b) (g_CrcTable[0][((crc) ^ (b)) & 0xFF] ^ ((crc) >> 8))
+#define CRC64_UPDATE_BYTE(crc, b) (g_Crc64Table[0][((crc) ^ (b)) & 0xFF] ^ ((crc) >> 8))
+
+UInt32 CrcUpdate(UInt32 crc, const void *data, SizeT size)
+{
+  const Byte *p = (const Byte *)data;
+  for (; size > 0 && ((size_t)p & 7) != 0; size--, p++)
+    crc = CRC_UPDATE_BYTE(crc, *p);
+  for (; size >= 8; size -= 8, p += 8)
+  {
+    UInt32 lo = crc ^ GetUi32(p);
+    UInt32 hi = GetUi32(p + 4);
+    crc =
+          g_CrcTable[7][lo & 0xFF]
+        ^ g_CrcTable[6][(lo >> 8) & 0xFF]
+        ^ g_CrcTable[5][(lo >> 16) & 0xFF]
+        ^ g_CrcTable[4][lo >> 24]
+        ^ g_CrcTable[3][hi & 0xFF]
+        ^ g_CrcTable[2][(hi >> 8) & 0xFF]
+        ^ g_CrcTable[1][(hi >> 16) & 0xFF]
+        ^ g_CrcTable[0][hi >> 24];
+  }
+  for (; size > 0; size--, p++)
+    crc = CRC_UPDATE_BYTE(crc, *p);
+  return crc;
+}
+
+UInt64 Crc64Update(UInt64 crc, const void *data, SizeT size)
+{
+  const Byte *p = (const Byte *)data;
+  for (; size > 0 && ((size_t)p & 7) != 0; size--, p++)
+    crc = CRC64_UPDATE_BYTE(crc, *p);
+  for (; size >= 8; size -= 8, p += 8)
+  {
+    UInt64 v = crc ^ GetUi64(p);
+    crc =
+          g_Crc64Table[7][v & 0xFF]
+        ^ g_Crc64Table[6][(v >> 8) & 0xFF]
+        ^ g_Crc64Table[5][(v >> 16) & 0xFF]
+        ^ g_Crc64Table[4][(v >> 24) & 0xFF]
+        ^ g_Crc64Table[3][(v >> 32) & 0xFF]
+        ^ g_Crc64Table[2][(v >> 40) & 0xFF]
+        ^ g_Crc64Table[1][(v >> 48) & 0xFF]
+        ^ g_Crc64Table[0][v >> 56];
+  }
+  for (; size > 0; size--, p++)
+    crc = CRC64_UPDATE_BYTE(crc, *p);
+  return crc;
+}
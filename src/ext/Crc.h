@@ -0,0 +1,38 @@
+/**
+ * PyBcj library.
+ * CRC32 (zlib/7z) and CRC64 (xz, ECMA-182) calculation.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef BCJ_CRC_H
+#define BCJ_CRC_H
+
+#include "Arch.h"
+
+EXTERN_C_BEGIN
+
+/*
+These functions update a running CRC register with slicing-by-8 tables.
+The register is kept inverted as in 7-Zip:
+
+    UInt32 crc = CRC_INIT_VAL;
+    crc = CrcUpdate(crc, data, size);
+    ...
+    digest = CRC_GET_DIGEST(crc);
+
+CrcGenerateTable() must be called before the first update. The tables are built
+by the first call only, and it can be called from any thread.
+*/
+
+#define CRC_INIT_VAL 0xFFFFFFFF
+#define CRC_GET_DIGEST(crc) ((crc) ^ CRC_INIT_VAL)
+
+#define CRC64_INIT_VAL UINT64_CONST(0xFFFFFFFFFFFFFFFF)
+#define CRC64_GET_DIGEST(crc) ((crc) ^ CRC64_INIT_VAL)
+
+void CrcGenerateTable(void);
+UInt32 CrcUpdate(UInt32 crc, const void *data, SizeT size);
+UInt64 Crc64Update(UInt64 crc, const void *data, SizeT size);
+
+EXTERN_C_END
+
+#endif
@@ -0,0 +1,563 @@
+/**
+ * PyBcj library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileIO.h"
+#include "Pipe.h"
+
+#ifdef _WIN32
+
+/* No positional I/O engine on Windows, files are streamed through BCJ_Pipe. */
+int
+BCJ_FileFilter(int srcFd, int dstFd, int arch, int encoding, UInt32 ip, UInt32 state,
+               SizeT blockSize, unsigned depth, int engine, int direct, UInt64 *written) {
+    (void) direct;
+    if (engine == BCJ_FILE_URING) {
+        return ENOSYS;
+    }
+    return BCJ_Pipe(srcFd, dstFd, arch, encoding, ip, state, blockSize, depth, written);
+}
+
+#else
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+/* IORING_OP_ASYNC_CANCEL came with Linux 5.5, as IORING_FEAT_NODROP */
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(IORING_FEAT_NODROP)
+#define BCJ_HAVE_URING
+#endif
+#endif
+#endif
+
+/* Largest size passed to a single read or write. */
+#define BCJ_FILE_IO_MAX (1 << 30)
+
+typedef struct {
+    /* aligned; BCJ_FILE_ALIGN bytes before data are free for carry bytes */
+    Byte *data;
+    UInt64 index;
+    /* bytes read, and bytes the block should have */
+    SizeT size;
+    SizeT expected;
+    /* converted bytes to write at outOffset, outDone of them written */
+    Byte *out;
+    SizeT outSize;
+    SizeT outDone;
+    UInt64 outOffset;
+    /* an operation is in flight, 0 or 1 */
+    int busy;
+    /* read is complete and the block waits for conversion, 0 or 1 */
+    int ready;
+    /* operation in flight is a write, 0 or 1 */
+    int writing;
+    struct iovec iov;
+} BCJFileSlot;
+
+#ifdef BCJ_HAVE_URING
+/* Minimal io_uring: one ring mapped by hand, used only from the calling thread. */
+typedef struct {
+    int fd;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+} BCJUring;
+
+static void
+BCJUring_free(BCJUring *ring) {
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != NULL && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+}
+
+static int
+BCJUring_init(BCJUring *ring, unsigned entries) {
+    struct io_uring_params params;
+    int err;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return errno;
+    }
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        ring->sqRing = NULL;
+        goto error;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            ring->cqRing = NULL;
+            goto error;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto error;
+    }
+    Byte *sq = (Byte *) ring->sqRing;
+    Byte *cq = (Byte *) ring->cqRing;
+    ring->sqHead = (unsigned *) (sq + params.sq_off.head);
+    ring->sqTail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sqMask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *) (sq + params.sq_off.array);
+    ring->cqHead = (unsigned *) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return 0;
+
+    error:
+    err = errno;
+    BCJUring_free(ring);
+    return err;
+}
+
+/* Queue a readv or writev of one iovec. The caller keeps fewer operations in flight than entries. */
+static void
+BCJUring_queue(BCJUring *ring, int op, int fd, struct iovec *iov, UInt64 offset, UInt64 userData) {
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (Byte) op;
+    sqe->fd = fd;
+    sqe->addr = (UInt64) (uintptr_t) iov;
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* user_data of cancel requests, which are not slot numbers */
+#define BCJ_URING_CANCEL ((UInt64) -1)
+
+/* Queue a request to cancel the operation queued with userData. */
+static void
+BCJUring_queue_cancel(BCJUring *ring, UInt64 userData) {
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = BCJ_URING_CANCEL;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Number of entries that can be queued before the next submit. */
+static unsigned
+BCJUring_room(BCJUring *ring) {
+    return ring->sqMask + 1 - (*ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE));
+}
+
+/* Submit queued operations and wait for at least one completion. */
+static int
+BCJUring_submit_and_wait(BCJUring *ring) {
+    for (;;) {
+        unsigned toSubmit = *ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        if (syscall(__NR_io_uring_enter, ring->fd, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0) >= 0) {
+            return 0;
+        }
+        // the kernel takes at most the queued entries, so retrying does not submit twice
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return errno;
+        }
+    }
+}
+#endif
+
+typedef struct {
+    int srcFd;
+    int dstFd;
+    SizeT blockSize;
+    /* srcFd is opened with O_DIRECT, 0 or 1 */
+    int direct;
+    BCJFileSlot *slots;
+    unsigned depth;
+    unsigned inFlight;
+    int err;
+#ifdef BCJ_HAVE_URING
+    int useUring;
+    /* io_uring_enter failed, the operations in flight are still owned by the kernel */
+    int ringFailed;
+    BCJUring ring;
+#endif
+    /* completions of the pread/pwrite engine: slot number and result */
+    unsigned *doneSlots;
+    ssize_t *doneResults;
+    unsigned doneCount;
+} BCJFile;
+
+static void
+BCJFile_submit(BCJFile *f, BCJFileSlot *slot) {
+    int fd;
+    UInt64 offset;
+
+    if (slot->writing) {
+        fd = f->dstFd;
+        offset = slot->outOffset + slot->outDone;
+        slot->iov.iov_base = slot->out + slot->outDone;
+        slot->iov.iov_len = slot->outSize - slot->outDone;
+    } else {
+        fd = f->srcFd;
+        if (f->direct) {
+            // O_DIRECT needs an aligned offset and buffer: a short read is continued
+            // from the start of its last partial page, which is read again
+            slot->size &= ~(SizeT) (BCJ_FILE_ALIGN - 1);
+        }
+        offset = slot->index * f->blockSize + slot->size;
+        slot->iov.iov_base = slot->data + slot->size;
+        slot->iov.iov_len = f->blockSize - slot->size;
+    }
+    if (slot->iov.iov_len > BCJ_FILE_IO_MAX) {
+        slot->iov.iov_len = BCJ_FILE_IO_MAX;
+    }
+    slot->busy = 1;
+    f->inFlight++;
+#ifdef BCJ_HAVE_URING
+    if (f->useUring) {
+        BCJUring_queue(&f->ring, slot->writing ? IORING_OP_WRITEV : IORING_OP_READV, fd,
+                       &slot->iov, offset, (UInt64) (slot - f->slots));
+        return;
+    }
+#endif
+    ssize_t res;
+    do {
+        res = slot->writing ? pwrite(fd, slot->iov.iov_base, slot->iov.iov_len, (off_t) offset)
+                            : pread(fd, slot->iov.iov_base, slot->iov.iov_len, (off_t) offset);
+    } while (res < 0 && errno == EINTR);
+    f->doneSlots[f->doneCount] = (unsigned) (slot - f->slots);
+    f->doneResults[f->doneCount] = res < 0 ? -errno : res;
+    f->doneCount++;
+}
+
+/* Handle a finished read or write; a short one is submitted again for the rest. */
+static void
+BCJFile_complete(BCJFile *f, BCJFileSlot *slot, ssize_t res) {
+    slot->busy = 0;
+    f->inFlight--;
+    if (res < 0) {
+        if (f->err == 0) {
+            f->err = (int) -res;
+        }
+        return;
+    }
+    if (f->err != 0) {
+        return;
+    }
+    if (slot->writing) {
+        if (res == 0) {
+            f->err = EIO;
+            return;
+        }
+        slot->outDone += (SizeT) res;
+        if (slot->outDone < slot->outSize) {
+            BCJFile_submit(f, slot);
+        } else {
+            slot->writing = 0;
+        }
+        return;
+    }
+    slot->size += (SizeT) res;
+    if (slot->size >= slot->expected) {
+        // the file may have grown, the size at the start is used
+        slot->size = slot->expected;
+        slot->ready = 1;
+    } else if (res == 0) {
+        // the file has shrunk
+        f->err = EIO;
+    } else {
+        BCJFile_submit(f, slot);
+    }
+}
+
+/* Submit queued operations, wait for at least one to finish and handle all finished ones. */
+static void
+BCJFile_reap(BCJFile *f) {
+#ifdef BCJ_HAVE_URING
+    if (f->useUring) {
+        int err = BCJUring_submit_and_wait(&f->ring);
+        if (err != 0) {
+            // stop here; BCJFile_cancel waits for the operations in flight before their buffers are freed
+            if (f->err == 0) {
+                f->err = err;
+            }
+            f->ringFailed = 1;
+            return;
+        }
+        unsigned head = *f->ring.cqHead;
+        unsigned tail = __atomic_load_n(f->ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &f->ring.cqes[head & f->ring.cqMask];
+            BCJFileSlot *slot = &f->slots[cqe->user_data];
+            ssize_t res = cqe->res;
+            __atomic_store_n(f->ring.cqHead, head + 1, __ATOMIC_RELEASE);
+            BCJFile_complete(f, slot, res);
+        }
+        return;
+    }
+#endif
+    while (f->doneCount > 0) {
+        f->doneCount--;
+        BCJFile_complete(f, &f->slots[f->doneSlots[f->doneCount]], f->doneResults[f->doneCount]);
+    }
+}
+
+#ifdef BCJ_HAVE_URING
+/*
+Cancel the operations in flight after an error and wait for all of them, so that their buffers
+and iovecs can be freed. Returns nonzero when the ring cannot do that: the kernel may then still
+complete them into the buffers, which must be left allocated.
+*/
+static int
+BCJFile_cancel(BCJFile *f) {
+    int *cancelled = calloc(f->depth, sizeof(int));
+
+    if (cancelled == NULL) {
+        return ENOMEM;
+    }
+    while (f->inFlight > 0) {
+        // operations that failed to be submitted go with their cancel requests
+        for (unsigned i = 0; i < f->depth && BCJUring_room(&f->ring) > 0; i++) {
+            if (f->slots[i].busy && !cancelled[i]) {
+                BCJUring_queue_cancel(&f->ring, i);
+                cancelled[i] = 1;
+            }
+        }
+        int err = BCJUring_submit_and_wait(&f->ring);
+        if (err != 0) {
+            free(cancelled);
+            return err;
+        }
+        unsigned head = *f->ring.cqHead;
+        unsigned tail = __atomic_load_n(f->ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &f->ring.cqes[head & f->ring.cqMask];
+            // a cancel request fails when its operation has already finished, which is fine
+            if (cqe->user_data != BCJ_URING_CANCEL) {
+                f->slots[cqe->user_data].busy = 0;
+                f->inFlight--;
+            }
+            __atomic_store_n(f->ring.cqHead, head + 1, __ATOMIC_RELEASE);
+        }
+    }
+    free(cancelled);
+    return 0;
+}
+#endif
+
+int
+BCJ_FileFilter(int srcFd, int dstFd, int arch, int encoding, UInt32 ip, UInt32 state,
+               SizeT blockSize, unsigned depth, int engine, int direct, UInt64 *written) {
+    BCJFile f;
+    struct stat st;
+    Byte *memory = NULL;
+    Byte carry[BCJ_FILE_ALIGN];
+    SizeT carrySize = 0;
+    UInt64 outOffset = 0;
+    int err;
+
+    if (blockSize == 0) {
+        blockSize = BCJ_PIPE_BLOCK_SIZE_DEFAULT;
+    }
+    if (depth == 0) {
+        depth = BCJ_FILE_QUEUE_DEPTH_DEFAULT;
+    }
+    if (arch < BCJ_PIPE_X86 || arch > BCJ_PIPE_ARM64 || ip % BCJ_Alignment(arch) != 0 || depth < 2 ||
+        srcFd < 0 || dstFd < 0 ||
+        engine < BCJ_FILE_AUTO || engine > BCJ_FILE_PREAD) {
+        return EINVAL;
+    }
+    if (direct && blockSize % BCJ_FILE_ALIGN != 0) {
+        blockSize += BCJ_FILE_ALIGN - blockSize % BCJ_FILE_ALIGN;
+    }
+    if (blockSize > (SizeT) -1 - 2 * BCJ_FILE_ALIGN) {
+        return ENOMEM;
+    }
+    // carry room in front, and every block aligned
+    SizeT stride = BCJ_FILE_ALIGN + (blockSize + BCJ_FILE_ALIGN - 1) / BCJ_FILE_ALIGN * BCJ_FILE_ALIGN;
+    if ((SizeT) -1 / depth < stride) {
+        return ENOMEM;
+    }
+    if (fstat(srcFd, &st) != 0) {
+        return errno;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return ESPIPE;
+    }
+    UInt64 fileSize = (UInt64) st.st_size;
+    UInt64 blocks = (fileSize + blockSize - 1) / blockSize;
+
+    memset(&f, 0, sizeof(f));
+    f.srcFd = srcFd;
+    f.dstFd = dstFd;
+    f.blockSize = blockSize;
+    f.direct = direct;
+    f.depth = depth;
+    f.slots = calloc(depth, sizeof(BCJFileSlot));
+    f.doneSlots = malloc(depth * sizeof(unsigned));
+    f.doneResults = malloc(depth * sizeof(ssize_t));
+    if (f.slots == NULL || f.doneSlots == NULL || f.doneResults == NULL ||
+        posix_memalign((void **) &memory, BCJ_FILE_ALIGN, stride * depth) != 0) {
+        err = ENOMEM;
+        goto finish;
+    }
+    for (unsigned i = 0; i < depth; i++) {
+        f.slots[i].data = memory + stride * i + BCJ_FILE_ALIGN;
+    }
+#ifdef BCJ_HAVE_URING
+    f.ring.fd = -1;
+    if (engine != BCJ_FILE_PREAD) {
+        err = BCJUring_init(&f.ring, depth);
+        if (err == 0) {
+            f.useUring = 1;
+        } else if (engine == BCJ_FILE_URING) {
+            goto finish;
+        }
+    }
+#else
+    if (engine == BCJ_FILE_URING) {
+        err = ENOSYS;
+        goto finish;
+    }
+#endif
+
+    UInt64 nextRead = 0;
+    UInt64 nextConv = 0;
+    for (;;) {
+        // fill free slots with next blocks
+        while (f.err == 0 && nextRead < blocks) {
+            BCJFileSlot *slot = &f.slots[nextRead % depth];
+            if (slot->busy || slot->ready) {
+                break;
+            }
+            UInt64 offset = nextRead * blockSize;
+            slot->index = nextRead;
+            slot->size = 0;
+            slot->expected = fileSize - offset < blockSize ? (SizeT) (fileSize - offset) : blockSize;
+            BCJFile_submit(&f, slot);
+            nextRead++;
+        }
+        // convert completed blocks in order and queue their writes
+        while (f.err == 0 && nextConv < blocks && f.slots[nextConv % depth].ready) {
+            BCJFileSlot *slot = &f.slots[nextConv % depth];
+            Byte *start = slot->data - carrySize;
+            memcpy(start, carry, carrySize);
+            SizeT size = carrySize + slot->size;
+            SizeT done = BCJ_Convert(arch, start, size, ip, &state, encoding);
+            ip += (UInt32) done;
+            if (nextConv + 1 == blocks) {
+                // pass the rest through, as flush() does
+                done = size;
+            }
+            carrySize = size - done;
+            memcpy(carry, start + done, carrySize);
+            slot->ready = 0;
+            slot->out = start;
+            slot->outSize = done;
+            slot->outDone = 0;
+            slot->outOffset = outOffset;
+            outOffset += done;
+            if (done > 0) {
+                slot->writing = 1;
+                BCJFile_submit(&f, slot);
+            }
+            nextConv++;
+        }
+        if (f.inFlight == 0) {
+            if (f.err != 0 || nextConv == blocks) {
+                break;
+            }
+            // converted blocks had nothing to write, their slots can be read again
+            continue;
+        }
+#ifdef BCJ_HAVE_URING
+        if (f.ringFailed) {
+            break;
+        }
+#endif
+        BCJFile_reap(&f);
+    }
+    err = f.err;
+    if (written != NULL) {
+        *written = outOffset;
+    }
+
+    finish:
+#ifdef BCJ_HAVE_URING
+    if (f.useUring) {
+        if (f.inFlight > 0 && BCJFile_cancel(&f) != 0) {
+            // the kernel may still write to the blocks or read the iovecs of the slots, leak them
+            memory = NULL;
+            f.slots = NULL;
+        }
+        BCJUring_free(&f.ring);
+    }
+#endif
+    free(memory);
+    free(f.slots);
+    free(f.doneSlots);
+    free(f.doneResults);
+    return err;
+}
+
+#endif
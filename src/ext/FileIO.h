@@ -0,0 +1,58 @@
+/**
+ * PyBcj library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef BCJ_FILEIO_H
+#define BCJ_FILEIO_H
+
+#include "Arch.h"
+
+EXTERN_C_BEGIN
+
+/* I/O engines of BCJ_FileFilter */
+enum BCJFileEngine {
+    BCJ_FILE_AUTO,      /* io_uring when the kernel has it, pread/pwrite otherwise */
+    BCJ_FILE_URING,     /* io_uring only, ENOSYS when it is not available */
+    BCJ_FILE_PREAD      /* pread/pwrite only */
+};
+
+/* Alignment of blocks, enough for O_DIRECT on common devices. */
+#define BCJ_FILE_ALIGN 4096
+
+#define BCJ_FILE_QUEUE_DEPTH_DEFAULT 8
+
+/*
+BCJ_FileFilter filters the regular file srcFd into dstFd from offset 0 of both,
+on the calling thread only.
+
+Up to depth aligned blocks are in flight: while next blocks are being read,
+the oldest completed one is converted in place and its write is queued.
+With io_uring the reads and writes are submitted together by one system call;
+the pread/pwrite engine runs the same schedule synchronously.
+srcFd may be opened with O_DIRECT when direct is set; blockSize is then
+rounded up to BCJ_FILE_ALIGN. dstFd should accept positional writes.
+
+  In:
+    arch      - one of BCJPipeArch
+    encoding  - 0 (for decoding), 1 (for encoding)
+    ip        - start offset of the stream
+    state     - state variable for x86 converter
+    blockSize - size of a block, 0 for default
+    depth     - number of blocks in flight (at least 2), 0 for default
+    engine    - one of BCJFileEngine
+    direct    - srcFd is opened with O_DIRECT, 0 or 1
+
+  Out:
+    written   - number of bytes written to dstFd, may be NULL
+
+  Returns:
+    0 on success, or an errno value. The end of the stream is flushed as BCJ_Pipe does.
+*/
+
+int BCJ_FileFilter(int srcFd, int dstFd, int arch, int encoding, UInt32 ip, UInt32 state,
+                   SizeT blockSize, unsigned depth, int engine, int direct, UInt64 *written);
+
+EXTERN_C_END
+
+#endif
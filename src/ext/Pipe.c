@@ -0,0 +1,400 @@
+/**
+ * PyBcj library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Bra.h"
+#include "Pipe.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#define BCJ_READ(fd, buf, size) _read((fd), (buf), (unsigned int) (size))
+#define BCJ_WRITE(fd, buf, size) _write((fd), (buf), (unsigned int) (size))
+typedef long long BCJIOSize;
+
+typedef volatile LONG64 BCJAtomic;
+#define ATOMIC_LOAD(p) ((UInt64) InterlockedCompareExchange64((p), 0, 0))
+#define ATOMIC_STORE(p, v) ((void) InterlockedExchange64((p), (LONG64) (v)))
+#define ATOMIC_ADD(p, v) ((void) InterlockedExchangeAdd64((p), (LONG64) (v)))
+#define ATOMIC_CAS(p, expected, v) (InterlockedCompareExchange64((p), (LONG64) (v), (LONG64) (expected)) == (LONG64) (expected))
+
+typedef HANDLE BCJThread;
+typedef CRITICAL_SECTION BCJMutex;
+typedef CONDITION_VARIABLE BCJCond;
+#define BCJ_THREAD_FUNC(name, arg) static unsigned __stdcall name(void *arg)
+#define BCJ_THREAD_RETURN return 0
+#define MUTEX_INIT(m) (InitializeCriticalSection(m), 0)
+#define MUTEX_DESTROY(m) DeleteCriticalSection(m)
+#define MUTEX_LOCK(m) EnterCriticalSection(m)
+#define MUTEX_UNLOCK(m) LeaveCriticalSection(m)
+#define COND_INIT(c) (InitializeConditionVariable(c), 0)
+#define COND_DESTROY(c) ((void) (c))
+#define COND_WAIT(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+#define COND_BROADCAST(c) WakeAllConditionVariable(c)
+
+static int
+BCJThread_create(BCJThread *thread, unsigned (__stdcall *func)(void *), void *arg) {
+    *thread = (HANDLE) _beginthreadex(NULL, 0, func, arg, 0, NULL);
+    return *thread == NULL ? errno : 0;
+}
+
+static void
+BCJThread_join(BCJThread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#define BCJ_READ(fd, buf, size) read((fd), (buf), (size))
+#define BCJ_WRITE(fd, buf, size) write((fd), (buf), (size))
+typedef ssize_t BCJIOSize;
+
+typedef _Atomic UInt64 BCJAtomic;
+#define ATOMIC_LOAD(p) atomic_load(p)
+#define ATOMIC_STORE(p, v) atomic_store((p), (v))
+#define ATOMIC_ADD(p, v) ((void) atomic_fetch_add((p), (v)))
+#define ATOMIC_CAS(p, expected, v) bcj_atomic_cas((p), (expected), (v))
+
+static int
+bcj_atomic_cas(BCJAtomic *p, UInt64 expected, UInt64 value) {
+    return atomic_compare_exchange_strong(p, &expected, value);
+}
+
+typedef pthread_t BCJThread;
+typedef pthread_mutex_t BCJMutex;
+typedef pthread_cond_t BCJCond;
+#define BCJ_THREAD_FUNC(name, arg) static void *name(void *arg)
+#define BCJ_THREAD_RETURN return NULL
+#define MUTEX_INIT(m) pthread_mutex_init((m), NULL)
+#define MUTEX_DESTROY(m) pthread_mutex_destroy(m)
+#define MUTEX_LOCK(m) pthread_mutex_lock(m)
+#define MUTEX_UNLOCK(m) pthread_mutex_unlock(m)
+#define COND_INIT(c) pthread_cond_init((c), NULL)
+#define COND_DESTROY(c) pthread_cond_destroy(c)
+#define COND_WAIT(c, m) pthread_cond_wait((c), (m))
+#define COND_BROADCAST(c) pthread_cond_broadcast(c)
+
+static int
+BCJThread_create(BCJThread *thread, void *(*func)(void *), void *arg) {
+    return pthread_create(thread, NULL, func, arg);
+}
+
+static void
+BCJThread_join(BCJThread thread) {
+    pthread_join(thread, NULL);
+}
+#endif
+
+/* Room for carry bytes before each block, larger than any converter window. */
+#define BCJ_PIPE_MARGIN 64
+
+/* Largest size passed to a single read or write call. */
+#define BCJ_PIPE_IO_MAX (1 << 30)
+
+/* Times a stage checks the ring again before it sleeps. */
+#define BCJ_PIPE_SPIN 128
+
+typedef struct {
+    /* BCJ_PIPE_MARGIN bytes before data are free for carry bytes */
+    Byte *data;
+    SizeT size;
+    /* last block of the stream, 0 or 1 */
+    int eof;
+    /* converted bytes for the writer */
+    Byte *out;
+    SizeT outSize;
+} BCJPipeBlock;
+
+/*
+ * Blocks go around the ring from the reader to the converter, to the writer,
+ * and back to the reader. Each counter is the number of blocks a stage has
+ * finished and is only written by that stage.
+ */
+typedef struct {
+    int srcFd;
+    int dstFd;
+    BCJPipeBlock *blocks;
+    unsigned count;
+    SizeT blockSize;
+
+    BCJAtomic readCount;
+    BCJAtomic convCount;
+    BCJAtomic writeCount;
+
+    /* first errno value of any stage, stops all the stages */
+    BCJAtomic error;
+
+    /* stages sleeping on cond */
+    BCJAtomic waiters;
+    BCJMutex mutex;
+    BCJCond cond;
+
+    UInt64 written;
+} BCJPipe;
+
+static void
+BCJPipe_wake(BCJPipe *p) {
+    if (ATOMIC_LOAD(&p->waiters) > 0) {
+        MUTEX_LOCK(&p->mutex);
+        COND_BROADCAST(&p->cond);
+        MUTEX_UNLOCK(&p->mutex);
+    }
+}
+
+static void
+BCJPipe_fail(BCJPipe *p, int err) {
+    ATOMIC_CAS(&p->error, 0, (UInt64) err);
+    BCJPipe_wake(p);
+}
+
+static void
+BCJPipe_publish(BCJPipe *p, BCJAtomic *counter, UInt64 value) {
+    ATOMIC_STORE(counter, value);
+    BCJPipe_wake(p);
+}
+
+/* Wait until counter reaches target. Returns -1 when any stage failed. */
+static int
+BCJPipe_wait(BCJPipe *p, BCJAtomic *counter, UInt64 target) {
+    for (int i = 0; i < BCJ_PIPE_SPIN; i++) {
+        if (ATOMIC_LOAD(&p->error) != 0) {
+            return -1;
+        }
+        if (ATOMIC_LOAD(counter) >= target) {
+            return 0;
+        }
+    }
+    MUTEX_LOCK(&p->mutex);
+    // the waiter count is raised before checking again, so publishers see it or we see them
+    ATOMIC_ADD(&p->waiters, 1);
+    while (ATOMIC_LOAD(counter) < target && ATOMIC_LOAD(&p->error) == 0) {
+        COND_WAIT(&p->cond, &p->mutex);
+    }
+    ATOMIC_ADD(&p->waiters, (UInt64) -1);
+    MUTEX_UNLOCK(&p->mutex);
+    return ATOMIC_LOAD(&p->error) != 0 ? -1 : 0;
+}
+
+BCJ_THREAD_FUNC(BCJPipe_reader, arg) {
+    BCJPipe *p = (BCJPipe *) arg;
+
+    for (UInt64 r = 0;; r++) {
+        // the writer should be done with the block used count times before
+        if (BCJPipe_wait(p, &p->writeCount, r >= p->count ? r + 1 - p->count : 0) < 0) {
+            BCJ_THREAD_RETURN;
+        }
+        BCJPipeBlock *block = &p->blocks[r % p->count];
+        block->size = 0;
+        block->eof = 0;
+        while (block->size < p->blockSize) {
+            SizeT size = p->blockSize - block->size;
+            BCJIOSize n = BCJ_READ(p->srcFd, block->data + block->size, size < BCJ_PIPE_IO_MAX ? size : BCJ_PIPE_IO_MAX);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                BCJPipe_fail(p, errno);
+                BCJ_THREAD_RETURN;
+            }
+            if (n == 0) {
+                block->eof = 1;
+                break;
+            }
+            block->size += (SizeT) n;
+        }
+        int eof = block->eof;
+        BCJPipe_publish(p, &p->readCount, r + 1);
+        if (eof) {
+            BCJ_THREAD_RETURN;
+        }
+    }
+}
+
+BCJ_THREAD_FUNC(BCJPipe_writer, arg) {
+    BCJPipe *p = (BCJPipe *) arg;
+
+    for (UInt64 w = 0;; w++) {
+        if (BCJPipe_wait(p, &p->convCount, w + 1) < 0) {
+            BCJ_THREAD_RETURN;
+        }
+        BCJPipeBlock *block = &p->blocks[w % p->count];
+        const Byte *data = block->out;
+        SizeT size = block->outSize;
+        while (size > 0) {
+            BCJIOSize n = BCJ_WRITE(p->dstFd, data, size < BCJ_PIPE_IO_MAX ? size : BCJ_PIPE_IO_MAX);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                BCJPipe_fail(p, errno);
+                BCJ_THREAD_RETURN;
+            }
+            data += n;
+            size -= (SizeT) n;
+            p->written += (UInt64) n;
+        }
+        int eof = block->eof;
+        BCJPipe_publish(p, &p->writeCount, w + 1);
+        if (eof) {
+            BCJ_THREAD_RETURN;
+        }
+    }
+}
+
+SizeT
+BCJ_Convert(int arch, Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding) {
+    switch (arch) {
+        case BCJ_PIPE_X86:
+            return x86_Convert(data, size, ip, state, encoding);
+        case BCJ_PIPE_ARM:
+            return ARM_Convert(data, size, ip, encoding);
+        case BCJ_PIPE_ARMT:
+            return ARMT_Convert(data, size, ip, encoding);
+        case BCJ_PIPE_PPC:
+            return PPC_Convert(data, size, ip, encoding);
+        case BCJ_PIPE_SPARC:
+            return SPARC_Convert(data, size, ip, encoding);
+        case BCJ_PIPE_IA64:
+            return IA64_Convert(data, size, ip, encoding);
+        case BCJ_PIPE_ARM64:
+            return ARM64_Convert(data, size, ip, encoding);
+        default:
+            // should not come here.
+            return 0;
+    }
+}
+
+unsigned
+BCJ_Alignment(int arch) {
+    switch (arch) {
+        case BCJ_PIPE_ARMT:
+            return 2;
+        case BCJ_PIPE_ARM:
+        case BCJ_PIPE_PPC:
+        case BCJ_PIPE_SPARC:
+        case BCJ_PIPE_ARM64:
+            return 4;
+        case BCJ_PIPE_IA64:
+            return 16;
+        default:
+            return 1;
+    }
+}
+
+/* Converter stage, runs on the calling thread. */
+static void
+BCJPipe_converter(BCJPipe *p, int arch, int encoding, UInt32 ip, UInt32 state) {
+    Byte carry[BCJ_PIPE_MARGIN];
+    SizeT carrySize = 0;
+
+    for (UInt64 c = 0;; c++) {
+        if (BCJPipe_wait(p, &p->readCount, c + 1) < 0) {
+            return;
+        }
+        BCJPipeBlock *block = &p->blocks[c % p->count];
+        // put the unconverted tail of the previous block in front of this one
+        Byte *start = block->data - carrySize;
+        memcpy(start, carry, carrySize);
+        SizeT size = carrySize + block->size;
+        SizeT done = BCJ_Convert(arch, start, size, ip, &state, encoding);
+        ip += (UInt32) done;
+        // the block may be read again as soon as it is published
+        int eof = block->eof;
+        if (eof) {
+            // pass the rest through, as flush() does
+            done = size;
+        }
+        carrySize = size - done;
+        memcpy(carry, start + done, carrySize);
+        block->out = start;
+        block->outSize = done;
+        BCJPipe_publish(p, &p->convCount, c + 1);
+        if (eof) {
+            return;
+        }
+    }
+}
+
+int
+BCJ_Pipe(int srcFd, int dstFd, int arch, int encoding, UInt32 ip, UInt32 state,
+         SizeT blockSize, unsigned blocks, UInt64 *written) {
+    BCJPipe pipe;
+    BCJThread reader, writer;
+    Byte *memory;
+    int err;
+
+    if (blockSize == 0) {
+        blockSize = BCJ_PIPE_BLOCK_SIZE_DEFAULT;
+    }
+    if (blocks == 0) {
+        blocks = BCJ_PIPE_BLOCKS_DEFAULT;
+    }
+    if (arch < BCJ_PIPE_X86 || arch > BCJ_PIPE_ARM64 || ip % BCJ_Alignment(arch) != 0 || blocks < 2 ||
+        srcFd < 0 || dstFd < 0) {
+        return EINVAL;
+    }
+    SizeT stride = BCJ_PIPE_MARGIN + blockSize;
+    if (stride < blockSize || (SizeT) -1 / blocks < stride) {
+        return ENOMEM;
+    }
+
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.srcFd = srcFd;
+    pipe.dstFd = dstFd;
+    pipe.count = blocks;
+    pipe.blockSize = blockSize;
+    memory = malloc(stride * blocks);
+    pipe.blocks = calloc(blocks, sizeof(BCJPipeBlock));
+    if (memory == NULL || pipe.blocks == NULL) {
+        free(memory);
+        free(pipe.blocks);
+        return ENOMEM;
+    }
+    for (unsigned i = 0; i < blocks; i++) {
+        pipe.blocks[i].data = memory + stride * i + BCJ_PIPE_MARGIN;
+    }
+    ATOMIC_STORE(&pipe.readCount, 0);
+    ATOMIC_STORE(&pipe.convCount, 0);
+    ATOMIC_STORE(&pipe.writeCount, 0);
+    ATOMIC_STORE(&pipe.error, 0);
+    ATOMIC_STORE(&pipe.waiters, 0);
+    if ((err = MUTEX_INIT(&pipe.mutex)) != 0) {
+        goto free_memory;
+    }
+    if ((err = COND_INIT(&pipe.cond)) != 0) {
+        goto destroy_mutex;
+    }
+
+    if ((err = BCJThread_create(&reader, BCJPipe_reader, &pipe)) != 0) {
+        goto destroy_cond;
+    }
+    if ((err = BCJThread_create(&writer, BCJPipe_writer, &pipe)) != 0) {
+        BCJPipe_fail(&pipe, err);
+        BCJThread_join(reader);
+        goto destroy_cond;
+    }
+    BCJPipe_converter(&pipe, arch, encoding, ip, state);
+    BCJThread_join(reader);
+    BCJThread_join(writer);
+    err = (int) ATOMIC_LOAD(&pipe.error);
+    if (written != NULL) {
+        *written = pipe.written;
+    }
+
+    destroy_cond:
+    COND_DESTROY(&pipe.cond);
+    destroy_mutex:
+    MUTEX_DESTROY(&pipe.mutex);
+    free_memory:
+    free(memory);
+    free(pipe.blocks);
+    return err;
+}
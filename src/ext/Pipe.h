@@ -0,0 +1,63 @@
+/**
+ * PyBcj library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef BCJ_PIPE_H
+#define BCJ_PIPE_H
+
+#include "Arch.h"
+
+EXTERN_C_BEGIN
+
+/* Architectures of the pipeline, in the same order as Method in _bcjmodule.c */
+enum BCJPipeArch {
+    BCJ_PIPE_X86,
+    BCJ_PIPE_ARM,
+    BCJ_PIPE_ARMT,
+    BCJ_PIPE_PPC,
+    BCJ_PIPE_SPARC,
+    BCJ_PIPE_IA64,
+    BCJ_PIPE_ARM64
+};
+
+/* Convert data in place with the converter of arch. Returns the number of processed bytes. */
+SizeT BCJ_Convert(int arch, Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding);
+
+/* Instruction alignment of arch; a start offset (ip) must be a multiple of it to round-trip. */
+unsigned BCJ_Alignment(int arch);
+
+#define BCJ_PIPE_BLOCK_SIZE_DEFAULT (1 << 20)
+#define BCJ_PIPE_BLOCKS_DEFAULT 4
+
+/*
+BCJ_Pipe filters everything read from srcFd into dstFd.
+
+A reader thread fills blocks from srcFd, the calling thread converts them in place,
+and a writer thread writes them to dstFd, so that reading, conversion and writing
+overlap. The stages pass a fixed ring of preallocated blocks to each other
+without locks; a stage only sleeps when the ring is empty or full for it.
+
+  In:
+    arch      - one of BCJPipeArch
+    encoding  - 0 (for decoding), 1 (for encoding)
+    ip        - start offset of the stream, a multiple of BCJ_Alignment(arch)
+    state     - state variable for x86 converter
+    blockSize - size of a block, 0 for default
+    blocks    - number of blocks in the ring (at least 2), 0 for default
+
+  Out:
+    written   - number of bytes written to dstFd, may be NULL
+
+  Returns:
+    0 on success, or an errno value. The end of the stream is converted and
+    passed through the same way as flush() of the filter objects.
+    Blocking descriptors are expected; EINTR is retried.
+*/
+
+int BCJ_Pipe(int srcFd, int dstFd, int arch, int encoding, UInt32 ip, UInt32 state,
+             SizeT blockSize, unsigned blocks, UInt64 *written);
+
+EXTERN_C_END
+
+#endif
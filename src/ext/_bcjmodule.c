@@ -5,10 +5,27 @@
  */
 #include "Python.h"
 #include "pythread.h"   /* For Python 3.6 */
-#include "structmember.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#ifdef MS_WINDOWS
+#include <io.h>
+#define BCJ_WRITE(fd, buf, size) _write((fd), (buf), (unsigned int) (size))
+#define BCJ_OPEN(path, flags, mode) _open((path), (flags) | O_BINARY | O_NOINHERIT, (mode))
+#define BCJ_CLOSE(fd) _close(fd)
+#else
+#include <unistd.h>
+#define BCJ_WRITE(fd, buf, size) write((fd), (buf), (size))
+#define BCJ_OPEN(path, flags, mode) open((path), (flags) | O_CLOEXEC, (mode))
+#define BCJ_CLOSE(fd) close(fd)
+#endif
 
 #include "Arch.h"
+#include "Arena.h"
 #include "Bra.h"
+#include "Crc.h"
+#include "FileIO.h"
+#include "Pipe.h"
 
 #ifndef Py_UNREACHABLE
 #define Py_UNREACHABLE() assert(0)
@@ -23,6 +40,8 @@
     } } while (0)
 #define RELEASE_LOCK(obj) PyThread_release_lock((obj)->lock)
 static const char init_twice_msg[] = "__init__ method is called twice.";
+static const char invalid_state_msg[] = "state should be in range 0 to 7.";
+static const char no_checksum_msg[] = "checksum is not enabled for this filter.";
 
 enum Method {
     x86,
@@ -30,9 +49,30 @@ enum Method {
     armt,
     ppc,
     sparc_arch,
-    ia64
+    ia64,
+    arm64
+};
+
+/* Smallest size that converters can find a branch in, for each Method.
+   Decoders pass the last (window - 1) bytes of the stream through. */
+static const SizeT windowSize[] = {5, 4, 4, 4, 4, 16, 4};
+
+enum Checksum {
+    check_none,
+    check_crc32,
+    check_crc64
 };
 
+/* Stream size is not known until flush(). */
+#define BCJ_SIZE_UNKNOWN ((size_t) -1)
+
+/* Point where a decoder can restart: stream offset, ip and x86 state there. */
+typedef struct {
+    UInt64 offset;
+    UInt32 ip;
+    UInt32 state;
+} BCJCheckpoint;
+
 typedef struct {
     PyObject_HEAD
 
@@ -51,13 +91,33 @@ typedef struct {
     /* __init__ has been called, 0 or 1. */
     char inited;
 
-    /* remaining data size when decode*/
+    /* remaining data size when decode, BCJ_SIZE_UNKNOWN for encoders and unknown size */
     size_t remiaining;
 
-    /* working buffer */
+    /* checksum of the unfiltered data */
+    enum Checksum checkType;
+    UInt64 check;
+
+    /* working buffer: decoded data not returned yet at [bufPos, bufConv),
+       carry data at [bufConv, bufSize) */
     Byte *buffer;
+    SizeT bufAlloc;
     SizeT bufSize;
     SizeT bufPos;
+    SizeT bufConv;
+
+    /* decoder needs more input to return more data, 0 or 1. */
+    char needsInput;
+
+    /* bytes processed since the start of the stream */
+    UInt64 position;
+
+    /* checkpoints recorded every indexInterval bytes, 0 to disable */
+    UInt64 indexInterval;
+    UInt64 indexNext;
+    BCJCheckpoint *index;
+    Py_ssize_t indexSize;
+    Py_ssize_t indexAlloc;
 } BCJFilter;
 
 /*
@@ -75,6 +135,7 @@ BCJFilter_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
     if (self->lock == NULL) {
         goto error;
     }
+    self->needsInput = 1;
     return (PyObject *) self;
 
     error:
@@ -88,799 +149,2448 @@ BCJFilter_dealloc(BCJFilter *self) {
     if (self->lock) {
         PyThread_free_lock(self->lock);
     }
+    BCJArena_free(self->buffer, self->bufAlloc);
+    PyMem_Free(self->index);
     PyTypeObject *tp = Py_TYPE(self);
     tp->tp_free((PyObject *) self);
     Py_DECREF(tp);
 }
 
 /*
- * Shared methods to process and flush.
+ * Checksum of the unfiltered data, that is input of encoders and output of decoders.
  */
-static SizeT
-BCJFilter_do_method(BCJFilter *self) {
-    SizeT outLen;
+static int
+BCJFilter_set_checksum(BCJFilter *self, const char *checksum) {
+    if (checksum == NULL) {
+        self->checkType = check_none;
+        self->check = 0;
+    } else if (strcmp(checksum, "crc32") == 0) {
+        self->checkType = check_crc32;
+        self->check = CRC_INIT_VAL;
+    } else if (strcmp(checksum, "crc64") == 0) {
+        self->checkType = check_crc64;
+        self->check = CRC64_INIT_VAL;
+    } else {
+        PyErr_Format(PyExc_ValueError,
+                     "Unsupported checksum: %s", checksum);
+        return -1;
+    }
+    return 0;
+}
+
+/* Set the stream size of decoders, None when it is not known. */
+static int
+BCJFilter_set_size(BCJFilter *self, PyObject *size) {
+    if (size == Py_None) {
+        self->remiaining = BCJ_SIZE_UNKNOWN;
+        return 0;
+    }
+    unsigned long long value = PyLong_AsUnsignedLongLong(size);
+    if (value == (unsigned long long) -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    self->remiaining = (size_t) value;
+    if ((unsigned long long) self->remiaining != value) {
+        PyErr_SetString(PyExc_OverflowError, "size is too large for size_t");
+        return -1;
+    }
+    return 0;
+}
+
+/* Check that startOffset fits the 32 bit ip and is aligned to the instructions of method,
+   which BCJ_Alignment() of Pipe.h takes in the same order. */
+static int
+BCJFilter_check_start_offset(enum Method method, unsigned long long startOffset) {
+    if (startOffset > 0xFFFFFFFFULL) {
+        PyErr_SetString(PyExc_ValueError, "start_offset should be in range 0 to 0xFFFFFFFF.");
+        return -1;
+    }
+    if (startOffset % BCJ_Alignment(method) != 0) {
+        PyErr_Format(PyExc_ValueError, "start_offset should be a multiple of %u for this filter.",
+                     BCJ_Alignment(method));
+        return -1;
+    }
+    return 0;
+}
+
+/* Update the checksum with the unfiltered side of a block that has just been converted or copied. */
+static void
+BCJFilter_update_checksum(BCJFilter *self, const Byte *data, SizeT size) {
+    switch (self->checkType) {
+        case check_crc32:
+            self->check = CrcUpdate((UInt32) self->check, data, size);
+            break;
+        case check_crc64:
+            self->check = Crc64Update(self->check, data, size);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Index of checkpoints, so that a decoder can start at the middle of the stream.
+ */
+static int
+BCJFilter_index_add(BCJFilter *self) {
+    if (self->indexSize == self->indexAlloc) {
+        Py_ssize_t newAlloc = self->indexAlloc < 16 ? 16 : self->indexAlloc * 2;
+        BCJCheckpoint *tmp = PyMem_Realloc(self->index, newAlloc * sizeof(BCJCheckpoint));
+        if (tmp == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->index = tmp;
+        self->indexAlloc = newAlloc;
+    }
+    BCJCheckpoint *cp = &self->index[self->indexSize++];
+    cp->offset = self->position;
+    cp->ip = self->ip;
+    cp->state = self->state;
+    self->indexNext = (self->position / self->indexInterval + 1) * self->indexInterval;
+    return 0;
+}
 
-    if (self->bufSize == self->bufPos) {
+static int
+BCJFilter_set_index(BCJFilter *self, unsigned long long interval) {
+    self->indexInterval = interval;
+    if (interval == 0) {
         return 0;
     }
+    // the start of the stream is always a restart point
+    return BCJFilter_index_add(self);
+}
+
+/*
+ * Shared methods to process and flush.
+ */
+
+/* Move the stream position forward over processed bytes. */
+static void
+BCJFilter_advance(BCJFilter *self, SizeT size) {
+    self->ip += (UInt32) size;
+    self->position += size;
+    if (self->remiaining != BCJ_SIZE_UNKNOWN) {
+        self->remiaining -= size;
+    }
+}
+
+/* Convert at most this size at once, so the second pass of the checksum over a block reads it from cache. */
+#define BCJ_BLOCK_SIZE (64 * 1024)
+
+/* Bytes of new data joined with the carry bytes, larger than any converter window. */
+#define BCJ_STITCH_SIZE 32
 
-    Byte* buf = self->buffer + self->bufPos;
-    SizeT size = self->bufSize - self->bufPos;
+static SizeT
+BCJFilter_do_method(BCJFilter *self, const Byte *src, Byte *dest, SizeT size) {
+    SizeT outLen;
 
     switch (self->method) {
         case x86:
-            outLen = x86_Convert(buf, size, self->ip, &self->state, self->isEncoder);
+            outLen = src == dest ? x86_Convert(dest, size, self->ip, &self->state, self->isEncoder)
+                                 : x86_Convert_Copy(src, dest, size, self->ip, &self->state, self->isEncoder);
             break;
         case arm:
-            outLen = ARM_Convert(buf, size, self->ip, self->isEncoder);
+            outLen = src == dest ? ARM_Convert(dest, size, self->ip, self->isEncoder)
+                                 : ARM_Convert_Copy(src, dest, size, self->ip, self->isEncoder);
             break;
         case armt:
-            outLen = ARMT_Convert(buf, size, self->ip, self->isEncoder);
+            outLen = src == dest ? ARMT_Convert(dest, size, self->ip, self->isEncoder)
+                                 : ARMT_Convert_Copy(src, dest, size, self->ip, self->isEncoder);
             break;
         case ppc:
-            outLen = PPC_Convert(buf, size, self->ip, self->isEncoder);
+            outLen = src == dest ? PPC_Convert(dest, size, self->ip, self->isEncoder)
+                                 : PPC_Convert_Copy(src, dest, size, self->ip, self->isEncoder);
             break;
         case sparc_arch:
-            outLen = SPARC_Convert(buf, size, self->ip, self->isEncoder);
+            outLen = src == dest ? SPARC_Convert(dest, size, self->ip, self->isEncoder)
+                                 : SPARC_Convert_Copy(src, dest, size, self->ip, self->isEncoder);
             break;
         case ia64:
-            outLen = IA64_Convert(buf, size, self->ip, self->isEncoder);
+            outLen = src == dest ? IA64_Convert(dest, size, self->ip, self->isEncoder)
+                                 : IA64_Convert_Copy(src, dest, size, self->ip, self->isEncoder);
+            break;
+        case arm64:
+            outLen = src == dest ? ARM64_Convert(dest, size, self->ip, self->isEncoder)
+                                 : ARM64_Convert_Copy(src, dest, size, self->ip, self->isEncoder);
             break;
         default:
             // should not come here.
             return 0;
     }
-    self->ip += outLen;
-    self->remiaining -= outLen;
+    BCJFilter_advance(self, outLen);
     return outLen;
 }
 
-static PyObject *
-BCJFilter_do_filter(BCJFilter *self, Py_buffer *data) {
-    ACQUIRE_LOCK(self);
+/*
+ * Pass over leading bytes that have no branch to convert.
+ * Returns the number of bytes that can be copied through unchanged.
+ */
+static SizeT
+BCJFilter_skip(BCJFilter *self, const Byte *data, SizeT size) {
+    SizeT skipLen;
 
-    if (data->len > 0) {
-        // allocate new buffer when current buffer is smaller than required.
-        SizeT carrySize = self->bufSize - self->bufPos;
-        SizeT newSize = data->len + carrySize;
-        if (self->bufSize == newSize) {
-            // reuse buffer
-            memcpy(self->buffer, self->buffer + self->bufPos, carrySize);
-            memcpy(self->buffer + carrySize, data->buf, data->len);
-            self->bufPos = 0;
-        } else {
-            Byte *tmp = PyMem_Malloc(newSize);
-            if (tmp == NULL) {
-                PyErr_NoMemory();
-                goto error;
+    switch (self->method) {
+        case x86:
+            skipLen = x86_Scan(data, size, &self->state);
+            break;
+        case arm:
+            skipLen = ARM_Scan(data, size);
+            break;
+        case armt:
+            skipLen = ARMT_Scan(data, size);
+            break;
+        case ppc:
+            skipLen = PPC_Scan(data, size);
+            break;
+        case sparc_arch:
+            skipLen = SPARC_Scan(data, size);
+            break;
+        case ia64:
+            skipLen = IA64_Scan(data, size);
+            break;
+        case arm64:
+            skipLen = ARM64_Scan(data, size);
+            break;
+        default:
+            // should not come here.
+            return 0;
+    }
+    BCJFilter_update_checksum(self, data, skipLen);
+    BCJFilter_advance(self, skipLen);
+    return skipLen;
+}
+
+/*
+ * Convert src into dest block by block and update checksum of unfiltered side.
+ * Returns the number of bytes written to dest, or -1 on error.
+ */
+static Py_ssize_t
+BCJFilter_convert(BCJFilter *self, const Byte *src, Byte *dest, SizeT size) {
+    SizeT done = 0;
+
+    while (done < size) {
+        SizeT blockSize = size - done;
+        if (blockSize > BCJ_BLOCK_SIZE) {
+            blockSize = BCJ_BLOCK_SIZE;
+        }
+        if (self->indexInterval > 0 && self->indexNext - self->position + BCJ_STITCH_SIZE < blockSize) {
+            // let the converter stop just after the next checkpoint
+            blockSize = (SizeT) (self->indexNext - self->position) + BCJ_STITCH_SIZE;
+        }
+        SizeT skipLen = BCJFilter_skip(self, src + done, blockSize);
+        if (skipLen > 0) {
+            // no branch in the head of the block, just copy it
+            if (dest != src) {
+                memcpy(dest + done, src + done, skipLen);
             }
-            memcpy(tmp, self->buffer + self->bufPos, carrySize);
-            if (self->buffer != NULL) {
-                PyMem_Free(self->buffer);
+            done += skipLen;
+        } else {
+            SizeT outLen = BCJFilter_do_method(self, src + done, dest + done, blockSize);
+            if (outLen == 0) {
+                break;
             }
-            memcpy(tmp + carrySize, data->buf, data->len);
-            self->buffer = tmp;
-            self->bufSize = newSize;
-            self->bufPos = 0;
+            BCJFilter_update_checksum(self, self->isEncoder ? src + done : dest + done, outLen);
+            done += outLen;
         }
-    } else if (self->bufPos < self->bufSize) {
-        // when input data size is zero and there is some carry data
-        SizeT carrySize = self->bufSize - self->bufPos;
-        Byte *tmp = PyMem_Malloc(carrySize);
-        if (tmp == NULL) {
-            PyErr_NoMemory();
-            goto error;
+        if (self->indexInterval > 0 && self->position >= self->indexNext) {
+            if (BCJFilter_index_add(self) < 0) {
+                return -1;
+            }
         }
-        memcpy(tmp, self->buffer + self->bufPos, carrySize);
-        PyMem_Free(self->buffer);
-        self->buffer = tmp;
-        self->bufSize = carrySize;
-        self->bufPos = 0;
-    } else {
-        // there is no data, return data with zero size
-        PyObject *result = PyBytes_FromStringAndSize(NULL, 0);
-        RELEASE_LOCK(self);
-        return result;
-    }
-
-    SizeT outLen = BCJFilter_do_method(self);
-    if (self->remiaining <= self->readAhead) {
-        // flush all the data
-        outLen = self->bufSize - self->bufPos;
     }
+    return (Py_ssize_t) done;
+}
 
-    PyObject *result = PyBytes_FromStringAndSize(NULL, outLen);
-    if (result == NULL) {
-        if (self->buffer != NULL) {
-            PyMem_Free(self->buffer);
-        }
-        PyErr_NoMemory();
-        goto error;
+/* Copy the unprocessed tail of the stream through without conversion. */
+static void
+BCJFilter_pass_through(BCJFilter *self, const Byte *src, Byte *dest, SizeT size) {
+    if (dest != NULL) {
+        memcpy(dest, src, size);
     }
-    char *posi = PyBytes_AS_STRING(result);
-    memcpy(posi, (const char*)(self->buffer + self->bufPos), outLen);
-    self->bufPos += outLen;
-    RELEASE_LOCK(self);
-    return result;
-
-    error:
-    RELEASE_LOCK(self);
-    return NULL;
-
+    BCJFilter_update_checksum(self, src, size);
+    BCJFilter_advance(self, size);
 }
 
-static PyObject *
-BCJFilter_do_flush(BCJFilter *self) {
-    PyObject *result;
+/* Make the working buffer large enough and move pending and carry data to the top. */
+static int
+BCJFilter_reserve(BCJFilter *self, SizeT size) {
+    SizeT carrySize = self->bufSize - self->bufPos;
 
-    ACQUIRE_LOCK(self);
-    if (self->bufPos == self->bufSize) {
-        result = PyBytes_FromStringAndSize(NULL, 0);
-    } else {
-        SizeT out_len = BCJFilter_do_method(self);
-        // override with all remaining data
-        out_len = self->bufSize - self->bufPos;
-        result = PyBytes_FromStringAndSize(NULL, out_len);
-        if (result == NULL) {
-            if (self->buffer != NULL) {
-                PyMem_Free(self->buffer);
-            }
+    if (self->bufAlloc < size) {
+        SizeT alloc;
+        Byte *tmp = BCJArena_alloc(size, &alloc);
+        if (tmp == NULL) {
             PyErr_NoMemory();
-            goto error;
+            return -1;
         }
-        char *posi = PyBytes_AS_STRING(result);
-        memcpy(posi, (const char *) self->buffer + self->bufPos, out_len);
-        if (self->buffer != NULL) {
-            PyMem_Free(self->buffer);
+        if (carrySize > 0) {
+            memcpy(tmp, self->buffer + self->bufPos, carrySize);
         }
+        BCJArena_free(self->buffer, self->bufAlloc);
+        self->buffer = tmp;
+        self->bufAlloc = alloc;
+    } else if (self->bufPos > 0) {
+        memmove(self->buffer, self->buffer + self->bufPos, carrySize);
     }
-    RELEASE_LOCK(self);
-    return result;
-
-    error:
-    RELEASE_LOCK(self);
-    return NULL;
+    self->bufConv -= self->bufPos;
+    self->bufPos = 0;
+    self->bufSize = carrySize;
+    return 0;
 }
 
 /*
- * BCJ(X86) Encoder.
+ * Convert carry data followed by data into dest in a single pass.
+ * dest should have room for carry size + size bytes.
+ * Unprocessed tail is kept in the working buffer as next carry data.
+ * There should be no pending decoded data in the buffer.
+ * Returns the number of bytes written to dest, or -1 on error.
  */
-static int
-BCJEncoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
+static Py_ssize_t
+BCJFilter_stream(BCJFilter *self, const Byte *data, SizeT size, Byte *dest) {
+    SizeT carrySize = self->bufSize - self->bufConv;
+    SizeT outLen = 0;
+
+    if (carrySize > 0) {
+        // join carry and head of the data, then convert across the boundary
+        SizeT headSize = size < BCJ_STITCH_SIZE ? size : BCJ_STITCH_SIZE;
+        if (BCJFilter_reserve(self, carrySize + headSize) < 0) {
+            return -1;
+        }
+        memcpy(self->buffer + carrySize, data, headSize);
+        Py_ssize_t len = BCJFilter_convert(self, self->buffer, dest, carrySize + headSize);
+        if (len < 0) {
+            return -1;
+        }
+        outLen = (SizeT) len;
+        if (outLen < carrySize) {
+            // too short to go over the carry; all the data is kept.
+            self->bufPos = outLen;
+            self->bufConv = outLen;
+            self->bufSize = carrySize + headSize;
+            return (Py_ssize_t) outLen;
+        }
+        data += outLen - carrySize;
+        size -= outLen - carrySize;
     }
-    self->inited = 1;
-    self->method = x86;
-    self->readAhead = 5;
-    self->isEncoder = True;
-    self->remiaining = INT_MAX;
-    return 0;
 
-    error:
-    return -1;
+    Py_ssize_t ret = BCJFilter_convert(self, data, dest + outLen, size);
+    if (ret < 0) {
+        return -1;
+    }
+    SizeT len = (SizeT) ret;
+    outLen += len;
+
+    // keep the tail as carry data
+    self->bufPos = 0;
+    self->bufConv = 0;
+    self->bufSize = 0;
+    if (BCJFilter_reserve(self, size - len) < 0) {
+        return -1;
+    }
+    memcpy(self->buffer, data + len, size - len);
+    self->bufSize = size - len;
+    return (Py_ssize_t) outLen;
 }
 
-PyDoc_STRVAR(BCJEncoder_encode_doc,
-"");
-
-static PyObject *
-BCJEncoder_encode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
+/*
+ * Input of encode() and decode(): a bytes-like object, or a list or tuple of them
+ * that is processed as one stream.
+ */
+typedef struct {
+    Py_buffer *bufs;
+    Py_ssize_t count;
+    SizeT total;
+    Py_buffer single;
+} BCJInput;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:BCJEncoder.encode", kwlist,
-                                     &data)) {
-        return NULL;
+static void
+BCJInput_release(BCJInput *input) {
+    for (Py_ssize_t i = 0; i < input->count; i++) {
+        PyBuffer_Release(&input->bufs[i]);
+    }
+    if (input->bufs != &input->single) {
+        PyMem_Free(input->bufs);
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
-    return result;
 }
 
-PyDoc_STRVAR(BCJEncoder_flush_doc,
-"");
-
-static PyObject *
-BCJEncoder_flush(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    PyObject* result = BCJFilter_do_flush(self);
-    return result;
+static int
+BCJInput_get(BCJInput *input, PyObject *data) {
+    input->bufs = NULL;
+    input->count = 0;
+    input->total = 0;
+    if (PyObject_CheckBuffer(data) || !(PyList_Check(data) || PyTuple_Check(data))) {
+        if (PyObject_GetBuffer(data, &input->single, PyBUF_SIMPLE) < 0) {
+            return -1;
+        }
+        input->bufs = &input->single;
+        input->count = 1;
+        input->total = input->single.len;
+        return 0;
+    }
+    // a tuple copy of a list, which another thread may change meanwhile
+    PyObject *seq = PyList_Check(data) ? PyList_AsTuple(data) : Py_NewRef(data);
+    if (seq == NULL) {
+        return -1;
+    }
+    Py_ssize_t count = PyTuple_GET_SIZE(seq);
+    if (count > 0) {
+        input->bufs = PyMem_Malloc(count * sizeof(Py_buffer));
+        if (input->bufs == NULL) {
+            Py_DECREF(seq);
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (PyObject_GetBuffer(PyTuple_GET_ITEM(seq, i), &input->bufs[i], PyBUF_SIMPLE) < 0) {
+            Py_DECREF(seq);
+            BCJInput_release(input);
+            return -1;
+        }
+        input->count++;
+        input->total += input->bufs[i].len;
+    }
+    Py_DECREF(seq);
+    return 0;
 }
 
 /*
- * BCJ(X86) Decoder.
+ * Arguments of METH_FASTCALL | METH_KEYWORDS methods and vectorcall constructors,
+ * without building a tuple and a dict for each call. kwlist names the parameters;
+ * the first maxPos can be given by position, the first minPos are required, and
+ * the rest are keyword-only.
  */
+typedef struct {
+    const char *fname;
+    const char *const *kwlist;
+    Py_ssize_t minPos;
+    Py_ssize_t maxPos;
+} BCJParser;
+
+/* Set values in the order of kwlist to borrowed references, NULL for missing ones. */
 static int
-BCJDecoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"size", NULL};
-    unsigned long long size;
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "K:BCJDecoder.__init__", kwlist,
-                                     &size)) {
+BCJParser_parse(const BCJParser *parser, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames,
+                PyObject **values) {
+    Py_ssize_t count = 0;
+
+    while (parser->kwlist[count] != NULL) {
+        count++;
+    }
+    if (nargs > parser->maxPos) {
+        PyErr_Format(PyExc_TypeError, "%s() takes at most %zd positional argument%s (%zd given)",
+                     parser->fname, parser->maxPos, parser->maxPos == 1 ? "" : "s", nargs);
         return -1;
     }
-
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        values[i] = i < nargs ? args[i] : NULL;
     }
-    self->inited = 1;
-    self->method = x86;
-    self->readAhead = 5;
-    self->isEncoder = False;
-    self->remiaining = (size_t)size;
-    if ((unsigned long long)self->remiaining != size) {
-        PyErr_SetString(PyExc_OverflowError, "size is too large for size_t");
-        goto error;
+    if (kwnames != NULL) {
+        for (Py_ssize_t k = 0; k < PyTuple_GET_SIZE(kwnames); k++) {
+            PyObject *key = PyTuple_GET_ITEM(kwnames, k);
+            Py_ssize_t i = 0;
+            while (i < count && PyUnicode_CompareWithASCIIString(key, parser->kwlist[i]) != 0) {
+                i++;
+            }
+            if (i == count) {
+                PyErr_Format(PyExc_TypeError, "'%U' is an invalid keyword argument for %s()",
+                             key, parser->fname);
+                return -1;
+            }
+            if (values[i] != NULL) {
+                PyErr_Format(PyExc_TypeError, "argument for %s() given by name ('%s') and position (%zd)",
+                             parser->fname, parser->kwlist[i], i + 1);
+                return -1;
+            }
+            values[i] = args[nargs + k];
+        }
+    }
+    for (Py_ssize_t i = 0; i < parser->minPos; i++) {
+        if (values[i] == NULL) {
+            PyErr_Format(PyExc_TypeError, "%s() missing required argument '%s' (pos %zd)",
+                         parser->fname, parser->kwlist[i], i + 1);
+            return -1;
+        }
     }
-    self->state = 0;
     return 0;
-
-    error:
-    return -1;
 }
 
-PyDoc_STRVAR(BCJDecoder_decode_doc,
-"");
+/* Converters of parsed values as the format units of PyArg_Parse; a missing value keeps *dest. */
 
-static PyObject *
-BCJDecoder_decode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
+/* "O": any object */
+static int
+BCJArg_object(PyObject *obj, const char *name, PyObject **dest) {
+    if (obj != NULL) {
+        *dest = obj;
+    }
+    return 0;
+}
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:BCJDecoder.decode", kwlist,
-                                     &data)) {
-        return NULL;
+/* "K": int, masked to unsigned long long */
+static int
+BCJArg_ull(PyObject *obj, const char *name, unsigned long long *dest) {
+    if (obj == NULL) {
+        return 0;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
-    return result;
+    if (!PyLong_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "argument '%s' must be int, not %.50s", name, Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+    *dest = PyLong_AsUnsignedLongLongMask(obj);
+    return *dest == (unsigned long long) -1 && PyErr_Occurred() ? -1 : 0;
 }
 
-/*
- * ARM Encoder.
- */
+/* "K" without the mask, for values checked against a range afterwards: an int that is negative
+   or does not fit becomes ULLONG_MAX, so the check rejects it instead of seeing its low bits. */
 static int
-ARMEncoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
+BCJArg_range(PyObject *obj, const char *name, unsigned long long *dest) {
+    if (obj == NULL) {
+        return 0;
+    }
+    if (!PyLong_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "argument '%s' must be int, not %.50s", name, Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+    *dest = PyLong_AsUnsignedLongLong(obj);
+    if (*dest == (unsigned long long) -1 && PyErr_Occurred()) {
+        if (!PyErr_ExceptionMatches(PyExc_OverflowError)) {
+            return -1;
+        }
+        PyErr_Clear();
     }
-    self->inited = 1;
-    self->method = arm;
-    self->readAhead = 4;
-    self->isEncoder = True;
-    self->remiaining = INT_MAX;
     return 0;
+}
 
-    error:
-    return -1;
+/* The same for the "O&" unit of PyArg_ParseTupleAndKeywords. */
+static int
+BCJArg_range_converter(PyObject *obj, void *dest) {
+    if (!PyLong_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "integer argument expected, got %.50s", Py_TYPE(obj)->tp_name);
+        return 0;
+    }
+    return BCJArg_range(obj, NULL, (unsigned long long *) dest) == 0;
+}
+
+/* "n": integer that fits Py_ssize_t */
+static int
+BCJArg_ssize(PyObject *obj, const char *name, Py_ssize_t *dest) {
+    if (obj == NULL) {
+        return 0;
+    }
+    *dest = PyNumber_AsSsize_t(obj, PyExc_OverflowError);
+    return *dest == -1 && PyErr_Occurred() ? -1 : 0;
+}
+
+/* "p": truth value */
+static int
+BCJArg_bool(PyObject *obj, const char *name, int *dest) {
+    if (obj == NULL) {
+        return 0;
+    }
+    *dest = PyObject_IsTrue(obj);
+    return *dest < 0 ? -1 : 0;
+}
+
+/* "z": str without null characters, or None for NULL */
+static int
+BCJArg_str(PyObject *obj, const char *name, const char **dest) {
+    Py_ssize_t len;
+
+    if (obj == NULL) {
+        return 0;
+    }
+    if (obj == Py_None) {
+        *dest = NULL;
+        return 0;
+    }
+    if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "argument '%s' must be str or None, not %.50s", name, Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+    *dest = PyUnicode_AsUTF8AndSize(obj, &len);
+    if (*dest == NULL) {
+        return -1;
+    }
+    if (strlen(*dest) != (size_t) len) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+        return -1;
+    }
+    return 0;
+}
+
+/* Split result into a list of memoryviews at the offsets in bounds. */
+static PyObject *
+BCJFilter_split_result(PyObject *result, const SizeT *bounds, Py_ssize_t count) {
+    PyObject *view = PyMemoryView_FromObject(result);
+    if (view == NULL) {
+        return NULL;
+    }
+    PyObject *list = PyList_New(count);
+    if (list == NULL) {
+        goto error;
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *item = PySequence_GetSlice(view, i > 0 ? (Py_ssize_t) bounds[i - 1] : 0, (Py_ssize_t) bounds[i]);
+        if (item == NULL) {
+            Py_CLEAR(list);
+            goto error;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+
+    error:
+    Py_DECREF(view);
+    return list;
+}
+
+/*
+ * Decode at most maxLength bytes. Input is appended to the carry data, and
+ * only as much as needed is converted in place; the rest waits for next calls.
+ */
+static PyObject *
+BCJFilter_do_filter_limited(BCJFilter *self, BCJInput *input, SizeT maxLength) {
+    PyObject *result;
+
+    if (input->total > 0) {
+        if (BCJFilter_reserve(self, self->bufSize - self->bufPos + input->total) < 0) {
+            return NULL;
+        }
+        for (Py_ssize_t i = 0; i < input->count; i++) {
+            memcpy(self->buffer + self->bufSize, input->bufs[i].buf, input->bufs[i].len);
+            self->bufSize += input->bufs[i].len;
+        }
+    }
+    while (self->bufConv - self->bufPos < maxLength && self->bufConv < self->bufSize) {
+        // convert a little more than requested, so the converter can go over its window
+        SizeT size = self->bufSize - self->bufConv;
+        SizeT wanted = maxLength - (self->bufConv - self->bufPos) + BCJ_STITCH_SIZE;
+        if (size > wanted) {
+            size = wanted;
+        }
+        Py_ssize_t len = BCJFilter_convert(self, self->buffer + self->bufConv, self->buffer + self->bufConv, size);
+        if (len < 0) {
+            return NULL;
+        }
+        if (len == 0) {
+            break;
+        }
+        self->bufConv += len;
+    }
+    if (self->remiaining <= self->readAhead) {
+        // flush all the data
+        BCJFilter_pass_through(self, self->buffer + self->bufConv, NULL, self->bufSize - self->bufConv);
+        self->bufConv = self->bufSize;
+    }
+
+    SizeT outLen = self->bufConv - self->bufPos;
+    if (outLen > maxLength) {
+        outLen = maxLength;
+    }
+    result = PyBytes_FromStringAndSize(outLen > 0 ? (const char *) self->buffer + self->bufPos : NULL, outLen);
+    if (result == NULL) {
+        return NULL;
+    }
+    self->bufPos += outLen;
+    self->needsInput = self->bufConv == self->bufPos && self->bufSize - self->bufConv < windowSize[self->method];
+    return result;
+}
+
+/*
+ * Filter input and return the result.
+ * When maxLength is negative, all the data that can be converted is returned.
+ * When asList is set, a list of memoryviews is returned, one for each input buffer.
+ */
+static PyObject *
+BCJFilter_do_filter(BCJFilter *self, BCJInput *input, Py_ssize_t maxLength, int asList) {
+    PyObject *result = NULL;
+    SizeT *bounds = NULL;
+
+    ACQUIRE_LOCK(self);
+
+    if (maxLength >= 0) {
+        result = BCJFilter_do_filter_limited(self, input, (SizeT) maxLength);
+        if (result != NULL && asList) {
+            SizeT size = PyBytes_GET_SIZE(result);
+            Py_SETREF(result, BCJFilter_split_result(result, &size, 1));
+        }
+        RELEASE_LOCK(self);
+        return result;
+    }
+
+    SizeT pendingSize = self->bufConv - self->bufPos;
+    SizeT carrySize = self->bufSize - self->bufConv;
+    SizeT skipLen = 0;
+    if (input->count == 1 && pendingSize == 0 && carrySize == 0 && self->indexInterval == 0) {
+        Py_buffer *data = &input->bufs[0];
+        skipLen = BCJFilter_skip(self, data->buf, data->len);
+        SizeT tailSize = data->len - skipLen;
+        if (data->obj != NULL && PyBytes_CheckExact(data->obj) &&
+            (tailSize == 0 || (tailSize < windowSize[self->method] && self->remiaining <= self->readAhead))) {
+            // nothing to convert and everything goes out, return the immutable input itself
+            BCJFilter_pass_through(self, (const Byte *) data->buf + skipLen, NULL, tailSize);
+            self->needsInput = 1;
+            result = asList ? Py_BuildValue("[N]", PyMemoryView_FromObject(data->obj)) : Py_NewRef(data->obj);
+            RELEASE_LOCK(self);
+            return result;
+        }
+    }
+
+    // pending data goes to the first segment, and the tail of the stream to the last
+    Py_ssize_t segments = input->count > 0 ? input->count : 1;
+    if (asList) {
+        bounds = PyMem_Malloc(segments * sizeof(SizeT));
+        if (bounds == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+    }
+    result = PyBytes_FromStringAndSize(NULL, pendingSize + carrySize + input->total);
+    if (result == NULL) {
+        goto error;
+    }
+    Byte *dest = (Byte *) PyBytes_AS_STRING(result);
+    SizeT outLen = 0;
+    if (pendingSize > 0) {
+        // data decoded by previous calls with max_length goes first
+        memcpy(dest, self->buffer + self->bufPos, pendingSize);
+        self->bufPos = self->bufConv;
+        outLen += pendingSize;
+    }
+    if (bounds != NULL) {
+        bounds[0] = outLen;
+    }
+    for (Py_ssize_t i = 0; i < input->count; i++) {
+        const Byte *data = (const Byte *) input->bufs[i].buf;
+        SizeT size = input->bufs[i].len;
+        if (i == 0 && skipLen > 0) {
+            memcpy(dest + outLen, data, skipLen);
+            outLen += skipLen;
+            data += skipLen;
+            size -= skipLen;
+        }
+        Py_ssize_t len = BCJFilter_stream(self, data, size, dest + outLen);
+        if (len < 0) {
+            goto error;
+        }
+        outLen += len;
+        if (bounds != NULL) {
+            bounds[i] = outLen;
+        }
+    }
+    if (self->remiaining <= self->readAhead) {
+        // flush all the data
+        carrySize = self->bufSize - self->bufConv;
+        BCJFilter_pass_through(self, self->buffer + self->bufConv, dest + outLen, carrySize);
+        self->bufPos = self->bufConv = self->bufSize;
+        outLen += carrySize;
+        if (bounds != NULL) {
+            bounds[segments - 1] = outLen;
+        }
+    }
+    if (outLen != (SizeT) PyBytes_GET_SIZE(result)) {
+        if (_PyBytes_Resize(&result, outLen) < 0) {
+            goto error;
+        }
+    }
+    self->needsInput = 1;
+    if (asList) {
+        Py_SETREF(result, BCJFilter_split_result(result, bounds, segments));
+    }
+    RELEASE_LOCK(self);
+    PyMem_Free(bounds);
+    return result;
+
+    error:
+    Py_XDECREF(result);
+    RELEASE_LOCK(self);
+    PyMem_Free(bounds);
+    return NULL;
+}
+
+/*
+ * Sink of encode_to() and decode_to(): a file descriptor or an object with write().
+ */
+
+/* Input is converted into a scratch buffer of this size, then written. */
+#define BCJ_SINK_CHUNK (256 * 1024)
+
+/* Largest size passed to a single write(2) call. */
+#define BCJ_WRITE_MAX (1 << 30)
+
+typedef struct {
+    int fd;
+    PyObject *obj;
+    Py_ssize_t written;
+} BCJSink;
+
+/*
+ * A writable io.FileIO, which has no buffer of its own, is written through its file
+ * descriptor without the GIL as an int sink is. Other objects are called.
+ */
+static int
+BCJSink_init_raw(BCJSink *sink) {
+    PyObject *io = PyImport_ImportModule("io");
+    if (io == NULL) {
+        return -1;
+    }
+    PyObject *fileIO = PyObject_GetAttrString(io, "FileIO");
+    Py_DECREF(io);
+    if (fileIO == NULL) {
+        return -1;
+    }
+    // subclasses may override write()
+    int exact = Py_IS_TYPE(sink->obj, (PyTypeObject *) fileIO);
+    Py_DECREF(fileIO);
+    if (!exact) {
+        return 0;
+    }
+    PyObject *writable = PyObject_CallMethod(sink->obj, "writable", NULL);
+    if (writable == NULL) {
+        // e.g. closed; let write() report it
+        PyErr_Clear();
+        return 0;
+    }
+    int isWritable = PyObject_IsTrue(writable);
+    Py_DECREF(writable);
+    if (isWritable <= 0) {
+        PyErr_Clear();
+        return 0;
+    }
+    int fd = PyObject_AsFileDescriptor(sink->obj);
+    if (fd < 0) {
+        PyErr_Clear();
+        return 0;
+    }
+    sink->fd = fd;
+    sink->obj = NULL;
+    return 0;
+}
+
+static int
+BCJSink_init(BCJSink *sink, PyObject *obj) {
+    sink->fd = -1;
+    sink->obj = NULL;
+    sink->written = 0;
+    if (PyLong_Check(obj)) {
+        long fd = PyLong_AsLong(obj);
+        if (fd == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (fd < 0 || fd > INT_MAX) {
+            PyErr_SetString(PyExc_ValueError, "file descriptor should be a non-negative int.");
+            return -1;
+        }
+        sink->fd = (int) fd;
+        return 0;
+    }
+    if (!PyObject_HasAttrString(obj, "write")) {
+        PyErr_SetString(PyExc_TypeError, "sink should be a file descriptor or have a write() method.");
+        return -1;
+    }
+    sink->obj = obj;
+    return BCJSink_init_raw(sink);
+}
+
+static int
+BCJSink_write_fd(BCJSink *sink, const Byte *data, SizeT size) {
+    while (size > 0) {
+        Py_ssize_t n;
+        int err;
+        Py_BEGIN_ALLOW_THREADS
+        n = BCJ_WRITE(sink->fd, data, size < BCJ_WRITE_MAX ? size : BCJ_WRITE_MAX);
+        err = errno;
+        Py_END_ALLOW_THREADS
+        if (n < 0) {
+            if (err == EINTR) {
+                if (PyErr_CheckSignals() < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            errno = err;
+            PyErr_SetFromErrno(PyExc_OSError);
+            return -1;
+        }
+        data += n;
+        size -= n;
+        sink->written += n;
+    }
+    return 0;
+}
+
+static int
+BCJSink_write_obj(BCJSink *sink, const Byte *data, SizeT size) {
+    while (size > 0) {
+        PyObject *view = PyMemoryView_FromMemory((char *) data, size, PyBUF_READ);
+        if (view == NULL) {
+            return -1;
+        }
+        PyObject *ret = PyObject_CallMethod(sink->obj, "write", "O", view);
+        PyObject *type, *value, *traceback;
+        // the memory is reused for next data, so the sink should not keep the view;
+        // an exception from write() is kept over the call of release()
+        PyErr_Fetch(&type, &value, &traceback);
+        PyObject *released = PyObject_CallMethod(view, "release", NULL);
+        Py_DECREF(view);
+        if (ret == NULL) {
+            Py_XDECREF(released);
+            PyErr_Restore(type, value, traceback);
+            return -1;
+        }
+        if (released == NULL) {
+            Py_DECREF(ret);
+            return -1;
+        }
+        Py_DECREF(released);
+        if (ret == Py_None) {
+            Py_DECREF(ret);
+            PyErr_SetString(PyExc_BlockingIOError, "sink is not ready for writing.");
+            return -1;
+        }
+        Py_ssize_t n = PyLong_AsSsize_t(ret);
+        Py_DECREF(ret);
+        if (n == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (n < 0 || (SizeT) n > size) {
+            PyErr_SetString(PyExc_ValueError, "write() of sink returned an invalid size.");
+            return -1;
+        }
+        data += n;
+        size -= n;
+        sink->written += n;
+    }
+    return 0;
+}
+
+/* Make the scratch buffer hold at least size bytes; its content is dropped. */
+static int
+BCJSink_reserve(Byte **scratch, SizeT *scratchAlloc, SizeT size) {
+    if (*scratchAlloc >= size) {
+        return 0;
+    }
+    BCJArena_free(*scratch, *scratchAlloc);
+    *scratch = BCJArena_alloc(size, scratchAlloc);
+    if (*scratch == NULL) {
+        *scratchAlloc = 0;
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+/* Move decoded data not returned yet into the scratch buffer, and set *size to its size. */
+static int
+BCJFilter_take_pending(BCJFilter *self, Byte **scratch, SizeT *scratchAlloc, SizeT *size) {
+    *size = self->bufConv - self->bufPos;
+    if (*size == 0) {
+        return 0;
+    }
+    if (BCJSink_reserve(scratch, scratchAlloc, *size) < 0) {
+        return -1;
+    }
+    memcpy(*scratch, self->buffer + self->bufPos, *size);
+    self->bufPos = self->bufConv;
+    return 0;
+}
+
+/*
+ * Write size bytes of the scratch buffer to sink; the lock of self is held.
+ * It is released around write() of an object, which may call the filter again,
+ * so the scratch buffer is the only memory written from, and data that
+ * decode(max_length=...) from write() left pending is written after it.
+ */
+static int
+BCJFilter_write_sink(BCJFilter *self, BCJSink *sink, Byte **scratch, SizeT *scratchAlloc, SizeT size) {
+    if (sink->obj == NULL) {
+        return BCJSink_write_fd(sink, *scratch, size);
+    }
+    while (size > 0) {
+        RELEASE_LOCK(self);
+        int ret = BCJSink_write_obj(sink, *scratch, size);
+        ACQUIRE_LOCK(self);
+        if (ret < 0 || BCJFilter_take_pending(self, scratch, scratchAlloc, &size) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Filter input and write the result to sink. Data is converted through
+ * a scratch buffer, no result object is made.
+ * When flush is set, the rest of the stream is written too.
+ * Returns the number of bytes written.
+ */
+static PyObject *
+BCJFilter_do_filter_to(BCJFilter *self, PyObject *sinkObj, BCJInput *input, int flush) {
+    BCJSink sink;
+    Byte *scratch = NULL;
+    SizeT scratchAlloc = 0;
+    SizeT outSize;
+
+    if (BCJSink_init(&sink, sinkObj) < 0) {
+        return NULL;
+    }
+
+    ACQUIRE_LOCK(self);
+    // data decoded by previous calls with max_length goes first
+    if (BCJFilter_take_pending(self, &scratch, &scratchAlloc, &outSize) < 0 ||
+        BCJFilter_write_sink(self, &sink, &scratch, &scratchAlloc, outSize) < 0) {
+        goto error;
+    }
+    SizeT chunk = input->total < BCJ_SINK_CHUNK ? input->total : BCJ_SINK_CHUNK;
+    for (Py_ssize_t i = 0; i < input->count; i++) {
+        const Byte *data = (const Byte *) input->bufs[i].buf;
+        SizeT size = input->bufs[i].len;
+        while (size > 0) {
+            SizeT len = size < chunk ? size : chunk;
+            // the carry data may have changed while the lock was released
+            if (BCJSink_reserve(&scratch, &scratchAlloc, self->bufSize - self->bufConv + len + BCJ_STITCH_SIZE) < 0) {
+                goto error;
+            }
+            Py_ssize_t outLen = BCJFilter_stream(self, data, len, scratch);
+            if (outLen < 0 || BCJFilter_write_sink(self, &sink, &scratch, &scratchAlloc, (SizeT) outLen) < 0) {
+                goto error;
+            }
+            data += len;
+            size -= len;
+        }
+    }
+    if (flush || self->remiaining <= self->readAhead) {
+        SizeT carrySize = self->bufSize - self->bufConv;
+        if (BCJSink_reserve(&scratch, &scratchAlloc, carrySize) < 0) {
+            goto error;
+        }
+        Byte *src = self->buffer + self->bufConv;
+        Py_ssize_t outLen = 0;
+        if (flush) {
+            outLen = BCJFilter_convert(self, src, scratch, carrySize);
+            if (outLen < 0) {
+                goto error;
+            }
+        }
+        // override with all remaining data
+        BCJFilter_pass_through(self, src + outLen, scratch + outLen, carrySize - (SizeT) outLen);
+        self->bufPos = self->bufConv = self->bufSize;
+        if (BCJFilter_write_sink(self, &sink, &scratch, &scratchAlloc, carrySize) < 0) {
+            goto error;
+        }
+    }
+    self->needsInput = 1;
+    RELEASE_LOCK(self);
+    BCJArena_free(scratch, scratchAlloc);
+    return PyLong_FromSsize_t(sink.written);
+
+    error:
+    RELEASE_LOCK(self);
+    BCJArena_free(scratch, scratchAlloc);
+    return NULL;
+}
+
+static PyObject *
+BCJFilter_do_flush(BCJFilter *self) {
+    PyObject *result;
+
+    ACQUIRE_LOCK(self);
+    SizeT pendingSize = self->bufConv - self->bufPos;
+    SizeT carrySize = self->bufSize - self->bufConv;
+    result = PyBytes_FromStringAndSize(NULL, pendingSize + carrySize);
+    if (result == NULL) {
+        goto error;
+    }
+    if (pendingSize > 0) {
+        memcpy(PyBytes_AS_STRING(result), self->buffer + self->bufPos, pendingSize);
+    }
+    if (carrySize > 0) {
+        Byte *dest = (Byte *) PyBytes_AS_STRING(result) + pendingSize;
+        Byte *src = self->buffer + self->bufConv;
+        Py_ssize_t outLen = BCJFilter_convert(self, src, dest, carrySize);
+        if (outLen < 0) {
+            Py_DECREF(result);
+            goto error;
+        }
+        // override with all remaining data
+        BCJFilter_pass_through(self, src + outLen, dest + outLen, carrySize - (SizeT) outLen);
+    }
+    BCJArena_free(self->buffer, self->bufAlloc);
+    self->buffer = NULL;
+    self->bufAlloc = 0;
+    self->bufSize = 0;
+    self->bufPos = 0;
+    self->bufConv = 0;
+    self->needsInput = 1;
+    RELEASE_LOCK(self);
+    return result;
+
+    error:
+    RELEASE_LOCK(self);
+    return NULL;
+}
+
+typedef int (*BCJInitFunc)(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+/* tp_init for subclasses and explicit __init__() calls: pass the tuple and the dict on as a vector. */
+static int
+BCJFilter_init_args(BCJFilter *self, PyObject *args, PyObject *kwargs, BCJInitFunc init) {
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+    Py_ssize_t nkw = kwargs != NULL ? PyDict_GET_SIZE(kwargs) : 0;
+    PyObject **stack;
+    PyObject *kwnames;
+    PyObject *key, *value;
+    Py_ssize_t pos = 0, i = 0;
+    int ret = -1;
+
+    if (nkw == 0) {
+        return init(self, &PyTuple_GET_ITEM(args, 0), nargs, NULL);
+    }
+    kwnames = PyTuple_New(nkw);
+    if (kwnames == NULL) {
+        return -1;
+    }
+    stack = PyMem_New(PyObject *, nargs + nkw);
+    if (stack == NULL) {
+        Py_DECREF(kwnames);
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (Py_ssize_t k = 0; k < nargs; k++) {
+        stack[k] = PyTuple_GET_ITEM(args, k);
+    }
+    // values are held, as converters may run code that changes the dict
+    while (PyDict_Next(kwargs, &pos, &key, &value)) {
+        if (!PyUnicode_Check(key)) {
+            PyErr_SetString(PyExc_TypeError, "keywords must be strings");
+            goto done;
+        }
+        PyTuple_SET_ITEM(kwnames, i, Py_NewRef(key));
+        stack[nargs + i] = Py_NewRef(value);
+        i++;
+    }
+    ret = init(self, stack, nargs, kwnames);
+
+    done:
+    for (Py_ssize_t k = 0; k < i; k++) {
+        Py_DECREF(stack[nargs + k]);
+    }
+    PyMem_Free(stack);
+    Py_DECREF(kwnames);
+    return ret;
+}
+
+/*
+ * Call of the types themselves, without a tuple and a dict for the arguments.
+ * tp_vectorcall is not inherited, so subclasses are created through tp_new and tp_init.
+ */
+static PyObject *
+BCJFilter_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames, BCJInitFunc init) {
+    PyObject *self = BCJFilter_new((PyTypeObject *) type, NULL, NULL);
+
+    if (self != NULL && init((BCJFilter *) self, args, PyVectorcall_NARGS(nargsf), kwnames) < 0) {
+        Py_CLEAR(self);
+    }
+    return self;
+}
+
+/*
+ * __init__ of all encoders and decoders. Decoders take size first, and x86 filters take state.
+ */
+static int
+BCJFilter_init_common(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames,
+                      const char *fname, enum Method method, Bool isEncoder) {
+    static const char *const encoderKwlist[] = {"checksum", "start_offset", "index_interval", NULL};
+    static const char *const x86EncoderKwlist[] = {"checksum", "start_offset", "state", "index_interval", NULL};
+    static const char *const decoderKwlist[] = {"size", "checksum", "start_offset", "index_interval", NULL};
+    static const char *const x86DecoderKwlist[] = {"size", "checksum", "start_offset", "state", "index_interval",
+                                                   NULL};
+    BCJParser parser = {fname, NULL, 0, isEncoder ? 1 : 2};
+    PyObject *values[5];
+    PyObject *size = Py_None;
+    const char *checksum = NULL;
+    unsigned long long startOffset = 0;
+    unsigned long long indexInterval = 0;
+    unsigned long long state = 0;
+    int i = 0;
+
+    if (isEncoder) {
+        parser.kwlist = method == x86 ? x86EncoderKwlist : encoderKwlist;
+    } else {
+        parser.kwlist = method == x86 ? x86DecoderKwlist : decoderKwlist;
+    }
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0) {
+        return -1;
+    }
+    if (!isEncoder && BCJArg_object(values[i++], "size", &size) < 0) {
+        return -1;
+    }
+    if (BCJArg_str(values[i++], "checksum", &checksum) < 0 ||
+        BCJArg_range(values[i++], "start_offset", &startOffset) < 0) {
+        return -1;
+    }
+    if (method == x86 && BCJArg_range(values[i++], "state", &state) < 0) {
+        return -1;
+    }
+    if (BCJArg_ull(values[i], "index_interval", &indexInterval) < 0) {
+        return -1;
+    }
+    if (state > 7) {
+        PyErr_SetString(PyExc_ValueError, invalid_state_msg);
+        return -1;
+    }
+    if (BCJFilter_check_start_offset(method, startOffset) < 0) {
+        return -1;
+    }
+
+    ACQUIRE_LOCK(self);
+    /* Only called once */
+    if (self->inited) {
+        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
+        goto error;
+    }
+    self->inited = 1;
+    self->method = method;
+    self->readAhead = windowSize[method] - 1;
+    self->isEncoder = isEncoder;
+    if (BCJFilter_set_size(self, size) < 0) {
+        goto error;
+    }
+    self->ip = (UInt32) startOffset;
+    self->state = (UInt32) state;
+    if (BCJFilter_set_checksum(self, checksum) < 0) {
+        goto error;
+    }
+    if (BCJFilter_set_index(self, indexInterval) < 0) {
+        goto error;
+    }
+    RELEASE_LOCK(self);
+    return 0;
+
+    error:
+    RELEASE_LOCK(self);
+    return -1;
+}
+
+/*
+ * BCJ(X86) Encoder.
+ */
+static int
+BCJEncoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "BCJEncoder.__init__", x86, True);
+}
+
+static int
+BCJEncoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, BCJEncoder_init);
+}
+
+static PyObject *
+BCJEncoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, BCJEncoder_init);
+}
+
+PyDoc_STRVAR(BCJEncoder_encode_doc,
+"");
+
+static PyObject *
+BCJEncoder_encode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "as_list", NULL};
+    static const BCJParser parser = {"BCJEncoder.encode", kwlist, 1, 1};
+    PyObject *values[2];
+    PyObject *data = NULL;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_bool(values[1], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, -1, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+PyDoc_STRVAR(BCJEncoder_flush_doc,
+"");
+
+static PyObject *
+BCJEncoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject* result = BCJFilter_do_flush(self);
+    return result;
+}
+
+/*
+ * BCJ(X86) Decoder.
+ */
+static int
+BCJDecoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "BCJDecoder.__init__", x86, False);
+}
+
+static int
+BCJDecoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, BCJDecoder_init);
+}
+
+static PyObject *
+BCJDecoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, BCJDecoder_init);
+}
+
+PyDoc_STRVAR(BCJDecoder_decode_doc,
+"");
+
+static PyObject *
+BCJDecoder_decode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "max_length", "as_list", NULL};
+    static const BCJParser parser = {"BCJDecoder.decode", kwlist, 1, 2};
+    PyObject *values[3];
+    PyObject *data = NULL;
+    Py_ssize_t maxLength = -1;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_ssize(values[1], "max_length", &maxLength) < 0 ||
+        BCJArg_bool(values[2], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, maxLength, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+/*
+ * ARM Encoder.
+ */
+static int
+ARMEncoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "ARMEncoder.__init__", arm, True);
+}
+
+static int
+ARMEncoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, ARMEncoder_init);
+}
+
+static PyObject *
+ARMEncoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, ARMEncoder_init);
 }
 
 PyDoc_STRVAR(ARMEncoder_encode_doc,
 "");
 
 static PyObject *
-ARMEncoder_encode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
+ARMEncoder_encode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "as_list", NULL};
+    static const BCJParser parser = {"ARMEncoder.encode", kwlist, 1, 1};
+    PyObject *values[2];
+    PyObject *data = NULL;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_bool(values[1], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, -1, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+PyDoc_STRVAR(ARMEncoder_flush_doc,
+"");
+
+static PyObject *
+ARMEncoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject* result = BCJFilter_do_flush(self);
+    return result;
+}
+
+/*
+ * ARM Decoder.
+ */
+static int
+ARMDecoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "ARMDecoder.__init__", arm, False);
+}
+
+static int
+ARMDecoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, ARMDecoder_init);
+}
+
+static PyObject *
+ARMDecoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, ARMDecoder_init);
+}
+
+PyDoc_STRVAR(ARMDecoder_decode_doc,
+"");
+
+static PyObject *
+ARMDecoder_decode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "max_length", "as_list", NULL};
+    static const BCJParser parser = {"ARMDecoder.decode", kwlist, 1, 2};
+    PyObject *values[3];
+    PyObject *data = NULL;
+    Py_ssize_t maxLength = -1;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_ssize(values[1], "max_length", &maxLength) < 0 ||
+        BCJArg_bool(values[2], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, maxLength, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+/*
+ * ARMT Encoder.
+ */
+static int
+ARMTEncoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "ARMTEncoder.__init__", armt, True);
+}
+
+static int
+ARMTEncoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, ARMTEncoder_init);
+}
+
+static PyObject *
+ARMTEncoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, ARMTEncoder_init);
+}
+
+PyDoc_STRVAR(ARMTEncoder_encode_doc,
+"");
+
+static PyObject *
+ARMTEncoder_encode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "as_list", NULL};
+    static const BCJParser parser = {"ARMTEncoder.encode", kwlist, 1, 1};
+    PyObject *values[2];
+    PyObject *data = NULL;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_bool(values[1], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, -1, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+PyDoc_STRVAR(ARMTEncoder_flush_doc,
+"");
+
+static PyObject *
+ARMTEncoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject* result = BCJFilter_do_flush(self);
+    return result;
+}
+
+/*
+ * ARMT Decoder.
+ */
+static int
+ARMTDecoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "ARMTDecoder.__init__", armt, False);
+}
+
+static int
+ARMTDecoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, ARMTDecoder_init);
+}
+
+static PyObject *
+ARMTDecoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, ARMTDecoder_init);
+}
+
+PyDoc_STRVAR(ARMTDecoder_decode_doc,
+"");
+
+static PyObject *
+ARMTDecoder_decode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "max_length", "as_list", NULL};
+    static const BCJParser parser = {"ARMTDecoder.decode", kwlist, 1, 2};
+    PyObject *values[3];
+    PyObject *data = NULL;
+    Py_ssize_t maxLength = -1;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_ssize(values[1], "max_length", &maxLength) < 0 ||
+        BCJArg_bool(values[2], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, maxLength, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+/*
+ * ARM64 Encoder.
+ */
+static int
+ARM64Encoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "ARM64Encoder.__init__", arm64, True);
+}
+
+static int
+ARM64Encoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, ARM64Encoder_init);
+}
+
+static PyObject *
+ARM64Encoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, ARM64Encoder_init);
+}
+
+PyDoc_STRVAR(ARM64Encoder_encode_doc,
+"");
+
+static PyObject *
+ARM64Encoder_encode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "as_list", NULL};
+    static const BCJParser parser = {"ARM64Encoder.encode", kwlist, 1, 1};
+    PyObject *values[2];
+    PyObject *data = NULL;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_bool(values[1], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, -1, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+PyDoc_STRVAR(ARM64Encoder_flush_doc,
+"");
+
+static PyObject *
+ARM64Encoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject* result = BCJFilter_do_flush(self);
+    return result;
+}
+
+/*
+ * ARM64 Decoder.
+ */
+static int
+ARM64Decoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "ARM64Decoder.__init__", arm64, False);
+}
+
+static int
+ARM64Decoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, ARM64Decoder_init);
+}
+
+static PyObject *
+ARM64Decoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, ARM64Decoder_init);
+}
+
+PyDoc_STRVAR(ARM64Decoder_decode_doc,
+"");
+
+static PyObject *
+ARM64Decoder_decode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "max_length", "as_list", NULL};
+    static const BCJParser parser = {"ARM64Decoder.decode", kwlist, 1, 2};
+    PyObject *values[3];
+    PyObject *data = NULL;
+    Py_ssize_t maxLength = -1;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_ssize(values[1], "max_length", &maxLength) < 0 ||
+        BCJArg_bool(values[2], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
+    }
+    PyObject* result = BCJFilter_do_filter(self, &input, maxLength, asList);
+    BCJInput_release(&input);
+    return result;
+}
+
+/*
+ * PPC Encoder.
+ */
+static int
+PPCEncoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "PPCEncoder.__init__", ppc, True);
+}
+
+static int
+PPCEncoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, PPCEncoder_init);
+}
+
+static PyObject *
+PPCEncoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, PPCEncoder_init);
+}
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:ARMEncoder.encode", kwlist,
-                                     &data)) {
+PyDoc_STRVAR(PPCEncoder_encode_doc,
+"");
+
+static PyObject *
+PPCEncoder_encode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "as_list", NULL};
+    static const BCJParser parser = {"PPCEncoder.encode", kwlist, 1, 1};
+    PyObject *values[2];
+    PyObject *data = NULL;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_bool(values[1], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
+    PyObject* result = BCJFilter_do_filter(self, &input, -1, asList);
+    BCJInput_release(&input);
     return result;
 }
 
-PyDoc_STRVAR(ARMEncoder_flush_doc,
+PyDoc_STRVAR(PPCEncoder_flush_doc,
 "");
 
 static PyObject *
-ARMEncoder_flush(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+PPCEncoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
     PyObject* result = BCJFilter_do_flush(self);
     return result;
 }
 
 /*
- * ARM Decoder.
+ * PPC Decoder.
  */
 static int
-ARMDecoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"size", NULL};
-    unsigned long long size;
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "K:ARMDecoder.__init__", kwlist,
-                                     &size)) {
-        return -1;
-    }
+PPCDecoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "PPCDecoder.__init__", ppc, False);
+}
 
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
-    }
-    self->inited = 1;
-    self->method = arm;
-    self->readAhead = 4;
-    self->isEncoder = False;
-    self->remiaining = (size_t)size;
-    if ((unsigned long long)self->remiaining != size) {
-        PyErr_SetString(PyExc_OverflowError, "size is too large for size_t");
-        goto error;
-    }
-    self->state = 0;
-    return 0;
+static int
+PPCDecoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, PPCDecoder_init);
+}
 
-    error:
-    return -1;
+static PyObject *
+PPCDecoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, PPCDecoder_init);
 }
 
-PyDoc_STRVAR(ARMDecoder_decode_doc,
+PyDoc_STRVAR(PPCDecoder_decode_doc,
 "");
 
 static PyObject *
-ARMDecoder_decode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:ARMDecoder.decode", kwlist,
-                                     &data)) {
+PPCDecoder_decode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "max_length", "as_list", NULL};
+    static const BCJParser parser = {"PPCDecoder.decode", kwlist, 1, 2};
+    PyObject *values[3];
+    PyObject *data = NULL;
+    Py_ssize_t maxLength = -1;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_ssize(values[1], "max_length", &maxLength) < 0 ||
+        BCJArg_bool(values[2], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
+    PyObject* result = BCJFilter_do_filter(self, &input, maxLength, asList);
+    BCJInput_release(&input);
     return result;
 }
 
 /*
- * ARMT Encoder.
+ * IA64 Encoder.
  */
 static int
-ARMTEncoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
-    }
-    self->inited = 1;
-    self->method = armt;
-    self->readAhead = 4;
-    self->isEncoder = True;
-    self->remiaining = INT_MAX;
-    return 0;
+IA64Encoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "IA64Encoder.__init__", ia64, True);
+}
 
-    error:
-    return -1;
+static int
+IA64Encoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, IA64Encoder_init);
 }
 
-PyDoc_STRVAR(ARMTEncoder_encode_doc,
+static PyObject *
+IA64Encoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, IA64Encoder_init);
+}
+
+PyDoc_STRVAR(IA64Encoder_encode_doc,
 "");
 
 static PyObject *
-ARMTEncoder_encode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:ARMTEncoder.encode", kwlist,
-                                     &data)) {
+IA64Encoder_encode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "as_list", NULL};
+    static const BCJParser parser = {"IA64Encoder.encode", kwlist, 1, 1};
+    PyObject *values[2];
+    PyObject *data = NULL;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_bool(values[1], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
+    PyObject* result = BCJFilter_do_filter(self, &input, -1, asList);
+    BCJInput_release(&input);
     return result;
 }
 
-PyDoc_STRVAR(ARMTEncoder_flush_doc,
+PyDoc_STRVAR(IA64Encoder_flush_doc,
 "");
 
 static PyObject *
-ARMTEncoder_flush(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+IA64Encoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
     PyObject* result = BCJFilter_do_flush(self);
     return result;
 }
 
 /*
- * ARMT Decoder.
+ * IA64 Decoder.
  */
 static int
-ARMTDecoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"size", NULL};
-    unsigned long long size;
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "K:ARMTDecoder.__init__", kwlist,
-                                     &size)) {
-        return -1;
-    }
+IA64Decoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "IA64Decoder.__init__", ia64, False);
+}
 
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
-    }
-    self->inited = 1;
-    self->method = armt;
-    self->readAhead = 4;
-    self->isEncoder = False;
-    self->remiaining = (size_t)size;
-    if ((unsigned long long)self->remiaining != size) {
-        PyErr_SetString(PyExc_OverflowError, "size is too large for size_t");
-        goto error;
-    }
-    self->state = 0;
-    return 0;
+static int
+IA64Decoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, IA64Decoder_init);
+}
 
-    error:
-    return -1;
+static PyObject *
+IA64Decoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, IA64Decoder_init);
 }
 
-PyDoc_STRVAR(ARMTDecoder_decode_doc,
+PyDoc_STRVAR(IA64Decoder_decode_doc,
 "");
 
 static PyObject *
-ARMTDecoder_decode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:ARMTDecoder.decode", kwlist,
-                                     &data)) {
+IA64Decoder_decode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "max_length", "as_list", NULL};
+    static const BCJParser parser = {"IA64Decoder.decode", kwlist, 1, 2};
+    PyObject *values[3];
+    PyObject *data = NULL;
+    Py_ssize_t maxLength = -1;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_ssize(values[1], "max_length", &maxLength) < 0 ||
+        BCJArg_bool(values[2], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
+    PyObject* result = BCJFilter_do_filter(self, &input, maxLength, asList);
+    BCJInput_release(&input);
     return result;
 }
 
+
 /*
- * PPC Encoder.
+ * Sparc Encoder.
  */
 static int
-PPCEncoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
-    }
-    self->inited = 1;
-    self->method = ppc;
-    self->readAhead = 4;
-    self->isEncoder = True;
-    self->remiaining = INT_MAX;
-    return 0;
+SparcEncoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "SparcEncoder.__init__", sparc_arch, True);
+}
 
-    error:
-    return -1;
+static int
+SparcEncoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, SparcEncoder_init);
 }
 
-PyDoc_STRVAR(PPCEncoder_encode_doc,
+static PyObject *
+SparcEncoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, SparcEncoder_init);
+}
+
+PyDoc_STRVAR(SparcEncoder_encode_doc,
 "");
 
 static PyObject *
-PPCEncoder_encode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:PPCEncoder.encode", kwlist,
-                                     &data)) {
+SparcEncoder_encode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "as_list", NULL};
+    static const BCJParser parser = {"SparcEncoder.encode", kwlist, 1, 1};
+    PyObject *values[2];
+    PyObject *data = NULL;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_bool(values[1], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
+    PyObject* result = BCJFilter_do_filter(self, &input, -1, asList);
+    BCJInput_release(&input);
     return result;
 }
 
-PyDoc_STRVAR(PPCEncoder_flush_doc,
+PyDoc_STRVAR(SparcEncoder_flush_doc,
 "");
 
 static PyObject *
-PPCEncoder_flush(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+SparcEncoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
     PyObject* result = BCJFilter_do_flush(self);
     return result;
 }
 
 /*
- * PPC Decoder.
+ * IA64 Decoder.
  */
 static int
-PPCDecoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"size", NULL};
-    unsigned long long size;
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "K:PPCDecoder.__init__", kwlist,
-                                     &size)) {
-        return -1;
-    }
+SparcDecoder_init(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return BCJFilter_init_common(self, args, nargs, kwnames, "SparcDecoder.__init__", sparc_arch, False);
+}
 
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
-    }
-    self->inited = 1;
-    self->method = ppc;
-    self->readAhead = 4;
-    self->isEncoder = False;
-    self->remiaining = (size_t)size;
-    if ((unsigned long long)self->remiaining != size) {
-        PyErr_SetString(PyExc_OverflowError, "size is too large for size_t");
-        goto error;
-    }
-    self->state = 0;
-    return 0;
+static int
+SparcDecoder_tp_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
+    return BCJFilter_init_args(self, args, kwargs, SparcDecoder_init);
+}
 
-    error:
-    return -1;
+static PyObject *
+SparcDecoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return BCJFilter_vectorcall(type, args, nargsf, kwnames, SparcDecoder_init);
 }
 
-PyDoc_STRVAR(PPCDecoder_decode_doc,
+PyDoc_STRVAR(SparcDecoder_decode_doc,
 "");
 
 static PyObject *
-PPCDecoder_decode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:PPCDecoder.decode", kwlist,
-                                     &data)) {
+SparcDecoder_decode(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "max_length", "as_list", NULL};
+    static const BCJParser parser = {"SparcDecoder.decode", kwlist, 1, 2};
+    PyObject *values[3];
+    PyObject *data = NULL;
+    Py_ssize_t maxLength = -1;
+    int asList = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "data", &data) < 0 ||
+        BCJArg_ssize(values[1], "max_length", &maxLength) < 0 ||
+        BCJArg_bool(values[2], "as_list", &asList) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
+    PyObject* result = BCJFilter_do_filter(self, &input, maxLength, asList);
+    BCJInput_release(&input);
     return result;
 }
 
 /*
- * IA64 Encoder.
+ * common function for python object.
  */
-static int
-IA64Encoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
+
+PyDoc_STRVAR(BCJFilter_digest_doc,
+"digest()\n"
+"----\n"
+"Return the CRC32 or CRC64 value of the unfiltered data processed so far.");
+
+static PyObject *
+BCJFilter_digest(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *result;
+
+    ACQUIRE_LOCK(self);
+    switch (self->checkType) {
+        case check_crc32:
+            result = PyLong_FromUnsignedLong(CRC_GET_DIGEST((UInt32) self->check));
+            break;
+        case check_crc64:
+            result = PyLong_FromUnsignedLongLong(CRC64_GET_DIGEST(self->check));
+            break;
+        default:
+            PyErr_SetString(PyExc_ValueError, no_checksum_msg);
+            result = NULL;
     }
-    self->inited = 1;
-    self->method = ia64;
-    self->readAhead = 4;
-    self->isEncoder = True;
-    self->remiaining = INT_MAX;
-    return 0;
+    RELEASE_LOCK(self);
+    return result;
+}
 
-    error:
-    return -1;
+/* Build a list of (offset, ip, state) tuples from the index. The lock should be held. */
+static PyObject *
+BCJFilter_index_list(BCJFilter *self) {
+    PyObject *result = PyList_New(self->indexSize);
+    if (result == NULL) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < self->indexSize; i++) {
+        BCJCheckpoint *cp = &self->index[i];
+        PyObject *item = Py_BuildValue("(KkI)", (unsigned long long) cp->offset,
+                                       (unsigned long) cp->ip, (unsigned int) cp->state);
+        if (item == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+    return result;
 }
 
-PyDoc_STRVAR(IA64Encoder_encode_doc,
-"");
+PyDoc_STRVAR(BCJFilter_checkpoints_doc,
+"checkpoints()\n"
+"----\n"
+"Return a list of (offset, ip, state) tuples recorded every index_interval bytes.\n"
+"A decoder created with start_offset=ip and state=state can start at offset.");
 
 static PyObject *
-IA64Encoder_encode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
+BCJFilter_checkpoints(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *result;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:IA64Encoder.encode", kwlist,
-                                     &data)) {
+    ACQUIRE_LOCK(self);
+    result = BCJFilter_index_list(self);
+    RELEASE_LOCK(self);
+    return result;
+}
+
+PyDoc_STRVAR(BCJFilter_reset_doc,
+"reset(size=None, *, start_offset=0, state=0)\n"
+"----\n"
+"Start a new stream with the same filter object, keeping allocated buffers.\n"
+"size is for decoders only, and state for x86 only.");
+
+static PyObject *
+BCJFilter_reset(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"size", "start_offset", "state", NULL};
+    static const BCJParser parser = {"reset", kwlist, 0, 1};
+    PyObject *values[3];
+    PyObject *size = Py_None;
+    unsigned long long startOffset = 0;
+    unsigned long long state = 0;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "size", &size) < 0 ||
+        BCJArg_range(values[1], "start_offset", &startOffset) < 0 ||
+        BCJArg_range(values[2], "state", &state) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
-    return result;
+
+    // method and direction are set by __init__ and __setstate__ under the lock
+    ACQUIRE_LOCK(self);
+    if (self->isEncoder && size != Py_None) {
+        PyErr_SetString(PyExc_TypeError, "size is not used for encoders.");
+        goto error;
+    }
+    if (state > 7 || (self->method != x86 && state != 0)) {
+        PyErr_SetString(PyExc_ValueError, invalid_state_msg);
+        goto error;
+    }
+    if (BCJFilter_check_start_offset(self->method, startOffset) < 0) {
+        goto error;
+    }
+    if (BCJFilter_set_size(self, size) < 0) {
+        goto error;
+    }
+    self->ip = (UInt32) startOffset;
+    self->state = (UInt32) state;
+    self->position = 0;
+    self->bufPos = 0;
+    self->bufConv = 0;
+    self->bufSize = 0;
+    self->needsInput = 1;
+    switch (self->checkType) {
+        case check_crc32:
+            self->check = CRC_INIT_VAL;
+            break;
+        case check_crc64:
+            self->check = CRC64_INIT_VAL;
+            break;
+        default:
+            self->check = 0;
+            break;
+    }
+    self->indexSize = 0;
+    if (BCJFilter_set_index(self, self->indexInterval) < 0) {
+        goto error;
+    }
+    RELEASE_LOCK(self);
+    Py_RETURN_NONE;
+
+    error:
+    RELEASE_LOCK(self);
+    return NULL;
 }
 
-PyDoc_STRVAR(IA64Encoder_flush_doc,
-"");
+PyDoc_STRVAR(BCJFilter_copy_doc,
+"copy()\n"
+"----\n"
+"Return a copy of the filter object, with its state and carry data.\n"
+"The copy can be used to process different continuations of the same prefix.");
 
 static PyObject *
-IA64Encoder_flush(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    PyObject* result = BCJFilter_do_flush(self);
-    return result;
+BCJFilter_copy(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyTypeObject *type = Py_TYPE(self);
+    BCJFilter *other = (BCJFilter *) BCJFilter_new(type, NULL, NULL);
+    if (other == NULL) {
+        return NULL;
+    }
+
+    ACQUIRE_LOCK(self);
+    SizeT carrySize = self->bufSize - self->bufPos;
+    if (carrySize > 0) {
+        other->buffer = BCJArena_alloc(carrySize, &other->bufAlloc);
+        if (other->buffer == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        memcpy(other->buffer, self->buffer + self->bufPos, carrySize);
+        other->bufSize = carrySize;
+        other->bufConv = self->bufConv - self->bufPos;
+    }
+    other->needsInput = self->needsInput;
+    if (self->indexSize > 0) {
+        other->index = PyMem_Malloc(self->indexSize * sizeof(BCJCheckpoint));
+        if (other->index == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        memcpy(other->index, self->index, self->indexSize * sizeof(BCJCheckpoint));
+        other->indexSize = self->indexSize;
+        other->indexAlloc = self->indexSize;
+    }
+    other->method = self->method;
+    other->ip = self->ip;
+    other->state = self->state;
+    other->readAhead = self->readAhead;
+    other->isEncoder = self->isEncoder;
+    other->inited = self->inited;
+    other->remiaining = self->remiaining;
+    other->checkType = self->checkType;
+    other->check = self->check;
+    other->position = self->position;
+    other->indexInterval = self->indexInterval;
+    other->indexNext = self->indexNext;
+    RELEASE_LOCK(self);
+    return (PyObject *) other;
+
+    error:
+    RELEASE_LOCK(self);
+    Py_DECREF(other);
+    return NULL;
+}
+
+static PyObject *
+BCJFilter_deepcopy(BCJFilter *self, PyObject *Py_UNUSED(memo)) {
+    return BCJFilter_copy(self, NULL);
 }
 
+PyDoc_STRVAR(BCJFilter_reduce_doc,
+"Return state information for pickling.");
+
 /*
- * IA64 Decoder.
+ * The object is created by copyreg.__newobj__ without calling __init__, so subclasses
+ * that take other arguments can be unpickled too; __setstate__ restores everything,
+ * including the instance dict of subclasses.
  */
-static int
-IA64Decoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"size", NULL};
-    unsigned long long size;
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "K:IA64Decoder.__init__", kwlist,
-                                     &size)) {
-        return -1;
+static PyObject *
+BCJFilter_reduce(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *copyreg = NULL;
+    PyObject *newobj = NULL;
+    PyObject *dict = NULL;
+    PyObject *carry = NULL;
+    PyObject *index = NULL;
+    PyObject *state = NULL;
+    PyObject *result = NULL;
+
+    copyreg = PyImport_ImportModule("copyreg");
+    if (copyreg == NULL) {
+        return NULL;
+    }
+    newobj = PyObject_GetAttrString(copyreg, "__newobj__");
+    Py_DECREF(copyreg);
+    if (newobj == NULL) {
+        return NULL;
+    }
+    // only subclasses have an instance dict
+    dict = PyObject_GetAttrString((PyObject *) self, "__dict__");
+    if (dict == NULL) {
+        if (!PyErr_ExceptionMatches(PyExc_AttributeError)) {
+            Py_DECREF(newobj);
+            return NULL;
+        }
+        PyErr_Clear();
+    }
+    if (dict == NULL || !PyDict_Check(dict) || PyDict_GET_SIZE(dict) == 0) {
+        Py_XSETREF(dict, Py_NewRef(Py_None));
     }
 
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
+    ACQUIRE_LOCK(self);
+    carry = PyBytes_FromStringAndSize(self->buffer == NULL ? NULL : (const char *) self->buffer + self->bufPos,
+                                      self->bufSize - self->bufPos);
+    if (carry == NULL) {
         goto error;
     }
-    self->inited = 1;
-    self->method = ia64;
-    self->readAhead = 4;
-    self->isEncoder = False;
-    self->remiaining = (size_t)size;
-    if ((unsigned long long)self->remiaining != size) {
-        PyErr_SetString(PyExc_OverflowError, "size is too large for size_t");
+    index = BCJFilter_index_list(self);
+    if (index == NULL) {
         goto error;
     }
-    self->state = 0;
-    return 0;
+    state = Py_BuildValue("(iiKIIKKOniKKKOO)",
+                          (int) self->method, (int) self->isEncoder,
+                          (unsigned long long) self->readAhead,
+                          (unsigned int) self->ip, (unsigned int) self->state,
+                          (unsigned long long) self->remiaining,
+                          (unsigned long long) self->position, carry,
+                          (Py_ssize_t) (self->bufConv - self->bufPos),
+                          (int) self->checkType, (unsigned long long) self->check,
+                          (unsigned long long) self->indexInterval,
+                          (unsigned long long) self->indexNext, index, dict);
+    if (state == NULL) {
+        goto error;
+    }
+    result = Py_BuildValue("O(O)N", newobj, (PyObject *) Py_TYPE(self), state);
 
     error:
-    return -1;
+    Py_XDECREF(carry);
+    Py_XDECREF(index);
+    RELEASE_LOCK(self);
+    Py_DECREF(dict);
+    Py_DECREF(newobj);
+    return result;
 }
 
-PyDoc_STRVAR(IA64Decoder_decode_doc,
-"");
+PyDoc_STRVAR(BCJFilter_setstate_doc,
+"Restore state information from pickling.");
 
-static PyObject *
-IA64Decoder_decode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
+/* x86 state of a filter or a checkpoint; other methods always have 0. */
+#define BCJ_STATE_VALID(method, state) ((state) <= 7 && ((state) == 0 || (method) == x86))
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:IA64Decoder.decode", kwlist,
-                                     &data)) {
+static PyObject *
+BCJFilter_setstate(BCJFilter *self, PyObject *args) {
+    int method, isEncoder, checkType;
+    unsigned long long readAhead, remaining, position, check, indexInterval, indexNext;
+    unsigned int ip, state;
+    Py_buffer carry;
+    Py_ssize_t pendingSize;
+    PyObject *indexList;
+    PyObject *dict;
+    BCJCheckpoint *index = NULL;
+    Py_ssize_t indexSize;
+    UInt32 startOffset;
+
+    if (!PyTuple_Check(args)) {
+        PyErr_SetString(PyExc_TypeError, "__setstate__ argument should be a tuple.");
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
-    return result;
-}
-
+    if (!PyArg_ParseTuple(args, "iiKIIKKy*niKKKO!O:__setstate__",
+                          &method, &isEncoder, &readAhead, &ip, &state, &remaining, &position,
+                          &carry, &pendingSize, &checkType, &check, &indexInterval, &indexNext,
+                          &PyList_Type, &indexList, &dict)) {
+        return NULL;
+    }
+    // ip advances together with position from the start offset
+    startOffset = (UInt32) ip - (UInt32) position;
+    if (method < x86 || method > arm64 || (isEncoder != False && isEncoder != True) ||
+        readAhead != (unsigned long long) windowSize[method] - 1 ||
+        !BCJ_STATE_VALID(method, state) || startOffset % BCJ_Alignment(method) != 0 ||
+        pendingSize < 0 || pendingSize > carry.len ||
+        checkType < check_none || checkType > check_crc64 ||
+        (unsigned long long) (size_t) remaining != remaining ||
+        (dict != Py_None && !PyDict_Check(dict))) {
+        goto invalid;
+    }
+    indexSize = PyList_GET_SIZE(indexList);
+    // the start of the stream is the first checkpoint when they are recorded
+    if ((indexInterval == 0) != (indexSize == 0)) {
+        goto invalid;
+    }
+    if (indexSize > 0) {
+        index = PyMem_Malloc(indexSize * sizeof(BCJCheckpoint));
+        if (index == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+    }
+    for (Py_ssize_t i = 0; i < indexSize; i++) {
+        unsigned long long cpOffset;
+        unsigned int cpIp, cpState;
+        PyObject *item = PyList_GET_ITEM(indexList, i);
+        if (!PyTuple_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "checkpoint should be a tuple.");
+            goto error;
+        }
+        if (!PyArg_ParseTuple(item, "KII:__setstate__",
+                              &cpOffset, &cpIp, &cpState)) {
+            goto error;
+        }
+        if ((i == 0 ? cpOffset != 0 : cpOffset <= index[i - 1].offset) || cpOffset > position ||
+            (UInt32) cpIp - (UInt32) cpOffset != startOffset || !BCJ_STATE_VALID(method, cpState)) {
+            goto invalid;
+        }
+        index[i].offset = cpOffset;
+        index[i].ip = cpIp;
+        index[i].state = cpState;
+    }
+    if (indexSize > 0 && indexNext != (index[indexSize - 1].offset / indexInterval + 1) * indexInterval) {
+        goto invalid;
+    }
 
-/*
- * Sparc Encoder.
- */
-static int
-SparcEncoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    /* Only called once */
+    ACQUIRE_LOCK(self);
     if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
+        if (method != (int) self->method || isEncoder != (int) self->isEncoder) {
+            RELEASE_LOCK(self);
+            goto invalid;
+        }
+    } else {
+        // created by copyreg.__newobj__ for unpickling
+        self->inited = 1;
+        self->method = (enum Method) method;
+        self->readAhead = (size_t) readAhead;
+        self->isEncoder = (Bool) isEncoder;
+    }
+    self->bufPos = 0;
+    self->bufConv = 0;
+    self->bufSize = 0;
+    if (BCJFilter_reserve(self, (SizeT) carry.len) < 0) {
+        RELEASE_LOCK(self);
         goto error;
     }
-    self->inited = 1;
-    self->method = sparc_arch;
-    self->readAhead = 4;
-    self->isEncoder = True;
-    self->remiaining = INT_MAX;
-    return 0;
+    if (carry.len > 0) {
+        memcpy(self->buffer, carry.buf, carry.len);
+    }
+    self->bufSize = (SizeT) carry.len;
+    self->bufConv = (SizeT) pendingSize;
+    self->needsInput = pendingSize == 0 && self->bufSize - self->bufConv < windowSize[self->method];
+    self->ip = ip;
+    self->state = state;
+    self->remiaining = (size_t) remaining;
+    self->position = position;
+    self->checkType = (enum Checksum) checkType;
+    self->check = check;
+    self->indexInterval = indexInterval;
+    self->indexNext = indexNext;
+    PyMem_Free(self->index);
+    self->index = index;
+    self->indexSize = indexSize;
+    self->indexAlloc = indexSize;
+    RELEASE_LOCK(self);
+    PyBuffer_Release(&carry);
+    if (dict != Py_None) {
+        PyObject *selfDict = PyObject_GetAttrString((PyObject *) self, "__dict__");
+        if (selfDict == NULL) {
+            return NULL;
+        }
+        int ret = PyDict_Update(selfDict, dict);
+        Py_DECREF(selfDict);
+        if (ret < 0) {
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
 
+    invalid:
+    PyErr_Format(PyExc_ValueError,
+                 "Invalid state for %s object.", Py_TYPE(self)->tp_name);
     error:
-    return -1;
+    PyMem_Free(index);
+    PyBuffer_Release(&carry);
+    return NULL;
 }
 
-PyDoc_STRVAR(SparcEncoder_encode_doc,
-"");
+PyDoc_STRVAR(BCJEncoder_encode_to_doc,
+"encode_to(sink, data, *, flush=False)\n"
+"----\n"
+"Encode data and write the result to sink, a file descriptor or an object with write().\n"
+"File descriptors and io.FileIO objects are written without the GIL. write() of other\n"
+"objects is called without the lock of the filter, and may use the filter itself.\n"
+"With flush=True the rest of the stream is written too. Returns the number of bytes written.");
 
 static PyObject *
-SparcEncoder_encode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:SparcEncoder.encode", kwlist,
-                                     &data)) {
+BCJEncoder_encode_to(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"sink", "data", "flush", NULL};
+    static const BCJParser parser = {"encode_to", kwlist, 2, 2};
+    PyObject *values[3];
+    PyObject *sink = NULL;
+    PyObject *data = NULL;
+    int flush = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "sink", &sink) < 0 ||
+        BCJArg_object(values[1], "data", &data) < 0 ||
+        BCJArg_bool(values[2], "flush", &flush) < 0) {
+        return NULL;
+    }
+    if (BCJInput_get(&input, data) < 0) {
         return NULL;
     }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
+    PyObject *result = BCJFilter_do_filter_to(self, sink, &input, flush);
+    BCJInput_release(&input);
     return result;
 }
 
-PyDoc_STRVAR(SparcEncoder_flush_doc,
-"");
+PyDoc_STRVAR(BCJDecoder_decode_to_doc,
+"decode_to(sink, data, *, flush=False)\n"
+"----\n"
+"Decode data and write the result to sink, a file descriptor or an object with write().\n"
+"File descriptors and io.FileIO objects are written without the GIL. write() of other\n"
+"objects is called without the lock of the filter, and may use the filter itself.\n"
+"With flush=True the rest of the stream is written too. Returns the number of bytes written.");
 
 static PyObject *
-SparcEncoder_flush(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    PyObject* result = BCJFilter_do_flush(self);
-    return result;
-}
-
-/*
- * IA64 Decoder.
- */
-static int
-SparcDecoder_init(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"size", NULL};
-    unsigned long long size;
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "K:SparcDecoder.__init__", kwlist,
-                                     &size)) {
-        return -1;
-    }
-
-    /* Only called once */
-    if (self->inited) {
-        PyErr_SetString(PyExc_RuntimeError, init_twice_msg);
-        goto error;
+BCJDecoder_decode_to(BCJFilter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"sink", "data", "flush", NULL};
+    static const BCJParser parser = {"decode_to", kwlist, 2, 2};
+    PyObject *values[3];
+    PyObject *sink = NULL;
+    PyObject *data = NULL;
+    int flush = 0;
+    BCJInput input;
+
+    if (BCJParser_parse(&parser, args, nargs, kwnames, values) < 0 ||
+        BCJArg_object(values[0], "sink", &sink) < 0 ||
+        BCJArg_object(values[1], "data", &data) < 0 ||
+        BCJArg_bool(values[2], "flush", &flush) < 0) {
+        return NULL;
     }
-    self->inited = 1;
-    self->method = sparc_arch;
-    self->readAhead = 4;
-    self->isEncoder = False;
-    self->remiaining = (size_t)size;
-    if ((unsigned long long)self->remiaining != size) {
-        PyErr_SetString(PyExc_OverflowError, "size is too large for size_t");
-        goto error;
+    if (BCJInput_get(&input, data) < 0) {
+        return NULL;
     }
-    self->state = 0;
-    return 0;
-
-    error:
-    return -1;
+    PyObject *result = BCJFilter_do_filter_to(self, sink, &input, flush);
+    BCJInput_release(&input);
+    return result;
 }
 
-PyDoc_STRVAR(SparcDecoder_decode_doc,
-"");
+PyDoc_STRVAR(BCJDecoder_flush_doc,
+"flush()\n"
+"----\n"
+"Return the rest of the stream, that is kept back when the size is not known.");
 
 static PyObject *
-SparcDecoder_decode(BCJFilter *self, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {"data", NULL};
-    Py_buffer data;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                     "y*:SparcDecoder.decode", kwlist,
-                                     &data)) {
-        return NULL;
-    }
-    PyObject* result = BCJFilter_do_filter(self, &data);
-    PyBuffer_Release(&data);
-    return result;
+BCJDecoder_flush(BCJFilter *self, PyObject *Py_UNUSED(ignored)) {
+    return BCJFilter_do_flush(self);
 }
 
-/*
- * common function for python object.
- */
+/*  define class and methods */
 
-PyDoc_STRVAR(reduce_cannot_pickle_doc,
-"Intentionally not supporting pickle.");
+PyDoc_STRVAR(BCJDecoder_needs_input_doc,
+"False if decode() can return more data without more input.");
 
+/* A getter rather than a member, so that it is not read while another thread updates it. */
 static PyObject *
-reduce_cannot_pickle(PyObject *self) {
-    PyErr_Format(PyExc_TypeError,
-                 "Cannot pickle %s object.",
-                 Py_TYPE(self)->tp_name);
-    return NULL;
+BCJDecoder_get_needs_input(BCJFilter *self, void *Py_UNUSED(closure)) {
+    char needsInput;
+
+    ACQUIRE_LOCK(self);
+    needsInput = self->needsInput;
+    RELEASE_LOCK(self);
+    return PyBool_FromLong(needsInput);
 }
 
-/*  define class and methods */
+static PyGetSetDef BCJDecoder_getset[] = {
+        {"needs_input", (getter) BCJDecoder_get_needs_input, NULL,
+                             BCJDecoder_needs_input_doc},
+        {NULL}
+};
 
 /* BCJ encoder */
 static PyMethodDef BCJEncoder_methods[] = {
         {"encode",     (PyCFunction) BCJEncoder_encode,
-                             METH_VARARGS | METH_KEYWORDS, BCJEncoder_encode_doc},
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_doc},
+        {"encode_to",  (PyCFunction) BCJEncoder_encode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_to_doc},
         {"flush",     (PyCFunction) BCJEncoder_flush,
-                METH_VARARGS | METH_KEYWORDS, BCJEncoder_flush_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                  reduce_cannot_pickle_doc},
+                METH_NOARGS, BCJEncoder_flush_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                            NULL}
 };
 
 static PyType_Slot BCJEncoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    BCJEncoder_init},
+        {Py_tp_init,    BCJEncoder_tp_init},
         {Py_tp_methods, BCJEncoder_methods},
         {0,             0}
 };
 
 static PyType_Spec BCJEncoder_type_spec = {
-        .name = "_bcj.BCJEncoder",
+        .name = "bcj._bcj.BCJEncoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = BCJEncoder_slots,
@@ -889,22 +2599,41 @@ static PyType_Spec BCJEncoder_type_spec = {
 /* BCJDecoder */
 static PyMethodDef BCJDecoder_methods[] = {
         {"decode",     (PyCFunction) BCJDecoder_decode,
-                             METH_VARARGS | METH_KEYWORDS, BCJDecoder_decode_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                  reduce_cannot_pickle_doc},
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_doc},
+        {"flush",      (PyCFunction) BCJDecoder_flush,
+                             METH_NOARGS,                  BCJDecoder_flush_doc},
+        {"decode_to",  (PyCFunction) BCJDecoder_decode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_to_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                            NULL}
 };
 
 static PyType_Slot BCJDecoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    BCJDecoder_init},
+        {Py_tp_init,    BCJDecoder_tp_init},
         {Py_tp_methods, BCJDecoder_methods},
+        {Py_tp_getset, BCJDecoder_getset},
         {0,             0}
 };
 
 static PyType_Spec BCJDecoder_type_spec = {
-        .name = "_bcj.BCJDecoder",
+        .name = "bcj._bcj.BCJDecoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = BCJDecoder_slots,
@@ -913,24 +2642,40 @@ static PyType_Spec BCJDecoder_type_spec = {
 /* ARM encoder */
 static PyMethodDef ARMEncoder_methods[] = {
         {"encode",     (PyCFunction) ARMEncoder_encode,
-                             METH_VARARGS | METH_KEYWORDS, ARMEncoder_encode_doc},
+                             METH_FASTCALL | METH_KEYWORDS, ARMEncoder_encode_doc},
+        {"encode_to",  (PyCFunction) BCJEncoder_encode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_to_doc},
         {"flush",     (PyCFunction) ARMEncoder_flush,
-                             METH_VARARGS | METH_KEYWORDS, ARMEncoder_flush_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                  reduce_cannot_pickle_doc},
+                             METH_NOARGS, ARMEncoder_flush_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                            NULL}
 };
 
 static PyType_Slot ARMEncoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    ARMEncoder_init},
+        {Py_tp_init,    ARMEncoder_tp_init},
         {Py_tp_methods, ARMEncoder_methods},
         {0,             0}
 };
 
 static PyType_Spec ARMEncoder_type_spec = {
-        .name = "_bcj.ARMEncoder",
+        .name = "bcj._bcj.ARMEncoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = ARMEncoder_slots,
@@ -939,22 +2684,41 @@ static PyType_Spec ARMEncoder_type_spec = {
 /* ARMDecoder */
 static PyMethodDef ARMDecoder_methods[] = {
         {"decode",     (PyCFunction) ARMDecoder_decode,
-                             METH_VARARGS | METH_KEYWORDS, ARMDecoder_decode_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                  reduce_cannot_pickle_doc},
+                             METH_FASTCALL | METH_KEYWORDS, ARMDecoder_decode_doc},
+        {"flush",      (PyCFunction) BCJDecoder_flush,
+                             METH_NOARGS,                  BCJDecoder_flush_doc},
+        {"decode_to",  (PyCFunction) BCJDecoder_decode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_to_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                            NULL}
 };
 
 static PyType_Slot ARMDecoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    ARMDecoder_init},
+        {Py_tp_init,    ARMDecoder_tp_init},
         {Py_tp_methods, ARMDecoder_methods},
+        {Py_tp_getset, BCJDecoder_getset},
         {0,             0}
 };
 
 static PyType_Spec ARMDecoder_type_spec = {
-        .name = "_bcj.ARMDecoder",
+        .name = "bcj._bcj.ARMDecoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = ARMDecoder_slots,
@@ -963,24 +2727,40 @@ static PyType_Spec ARMDecoder_type_spec = {
 /* ARMT encoder */
 static PyMethodDef ARMTEncoder_methods[] = {
         {"encode",     (PyCFunction) ARMTEncoder_encode,
-                             METH_VARARGS | METH_KEYWORDS, ARMTEncoder_encode_doc},
+                             METH_FASTCALL | METH_KEYWORDS, ARMTEncoder_encode_doc},
+        {"encode_to",  (PyCFunction) BCJEncoder_encode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_to_doc},
         {"flush",     (PyCFunction) ARMTEncoder_flush,
-                             METH_VARARGS | METH_KEYWORDS, ARMTEncoder_flush_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                  reduce_cannot_pickle_doc},
+                             METH_NOARGS, ARMTEncoder_flush_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                            NULL}
 };
 
 static PyType_Slot ARMTEncoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    ARMTEncoder_init},
+        {Py_tp_init,    ARMTEncoder_tp_init},
         {Py_tp_methods, ARMTEncoder_methods},
         {0,             0}
 };
 
 static PyType_Spec ARMTEncoder_type_spec = {
-        .name = "_bcj.ARMTEncoder",
+        .name = "bcj._bcj.ARMTEncoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = ARMTEncoder_slots,
@@ -989,48 +2769,168 @@ static PyType_Spec ARMTEncoder_type_spec = {
 /* ARMTDecoder */
 static PyMethodDef ARMTDecoder_methods[] = {
         {"decode",     (PyCFunction) ARMTDecoder_decode,
-                             METH_VARARGS | METH_KEYWORDS, ARMTDecoder_decode_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                reduce_cannot_pickle_doc},
+                             METH_FASTCALL | METH_KEYWORDS, ARMTDecoder_decode_doc},
+        {"flush",      (PyCFunction) BCJDecoder_flush,
+                             METH_NOARGS,                  BCJDecoder_flush_doc},
+        {"decode_to",  (PyCFunction) BCJDecoder_decode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_to_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                          NULL}
 };
 
 static PyType_Slot ARMTDecoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    ARMTDecoder_init},
+        {Py_tp_init,    ARMTDecoder_tp_init},
         {Py_tp_methods, ARMTDecoder_methods},
+        {Py_tp_getset, BCJDecoder_getset},
         {0,             0}
 };
 
 static PyType_Spec ARMTDecoder_type_spec = {
-        .name = "_bcj.ARMTDecoder",
+        .name = "bcj._bcj.ARMTDecoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = ARMTDecoder_slots,
 };
 
+/* ARM64 encoder */
+static PyMethodDef ARM64Encoder_methods[] = {
+        {"encode",     (PyCFunction) ARM64Encoder_encode,
+                             METH_FASTCALL | METH_KEYWORDS, ARM64Encoder_encode_doc},
+        {"encode_to",  (PyCFunction) BCJEncoder_encode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_to_doc},
+        {"flush",     (PyCFunction) ARM64Encoder_flush,
+                             METH_NOARGS, ARM64Encoder_flush_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
+        {NULL,         NULL, 0,                            NULL}
+};
+
+static PyType_Slot ARM64Encoder_slots[] = {
+        {Py_tp_new,     BCJFilter_new},
+        {Py_tp_dealloc, BCJFilter_dealloc},
+        {Py_tp_init,    ARM64Encoder_tp_init},
+        {Py_tp_methods, ARM64Encoder_methods},
+        {0,             0}
+};
+
+static PyType_Spec ARM64Encoder_type_spec = {
+        .name = "bcj._bcj.ARM64Encoder",
+        .basicsize = sizeof(BCJFilter),
+        .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+        .slots = ARM64Encoder_slots,
+};
+
+/* ARM64Decoder */
+static PyMethodDef ARM64Decoder_methods[] = {
+        {"decode",     (PyCFunction) ARM64Decoder_decode,
+                             METH_FASTCALL | METH_KEYWORDS, ARM64Decoder_decode_doc},
+        {"flush",      (PyCFunction) BCJDecoder_flush,
+                             METH_NOARGS,                  BCJDecoder_flush_doc},
+        {"decode_to",  (PyCFunction) BCJDecoder_decode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_to_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
+        {NULL,         NULL, 0,                            NULL}
+};
+
+static PyType_Slot ARM64Decoder_slots[] = {
+        {Py_tp_new,     BCJFilter_new},
+        {Py_tp_dealloc, BCJFilter_dealloc},
+        {Py_tp_init,    ARM64Decoder_tp_init},
+        {Py_tp_methods, ARM64Decoder_methods},
+        {Py_tp_getset, BCJDecoder_getset},
+        {0,             0}
+};
+
+static PyType_Spec ARM64Decoder_type_spec = {
+        .name = "bcj._bcj.ARM64Decoder",
+        .basicsize = sizeof(BCJFilter),
+        .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+        .slots = ARM64Decoder_slots,
+};
+
 /* PPC encoder */
 static PyMethodDef PPCEncoder_methods[] = {
         {"encode",     (PyCFunction) PPCEncoder_encode,
-                             METH_VARARGS | METH_KEYWORDS, PPCEncoder_encode_doc},
+                             METH_FASTCALL | METH_KEYWORDS, PPCEncoder_encode_doc},
+        {"encode_to",  (PyCFunction) BCJEncoder_encode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_to_doc},
         {"flush",     (PyCFunction) PPCEncoder_flush,
-                             METH_VARARGS | METH_KEYWORDS, PPCEncoder_flush_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,              reduce_cannot_pickle_doc},
+                             METH_NOARGS, PPCEncoder_flush_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                        NULL}
 };
 
 static PyType_Slot PPCEncoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    PPCEncoder_init},
+        {Py_tp_init,    PPCEncoder_tp_init},
         {Py_tp_methods, PPCEncoder_methods},
         {0,             0}
 };
 
 static PyType_Spec PPCEncoder_type_spec = {
-        .name = "_bcj.PPCEncoder",
+        .name = "bcj._bcj.PPCEncoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = PPCEncoder_slots,
@@ -1039,22 +2939,41 @@ static PyType_Spec PPCEncoder_type_spec = {
 /* PPCDecoder */
 static PyMethodDef PPCDecoder_methods[] = {
         {"decode",     (PyCFunction) PPCDecoder_decode,
-                             METH_VARARGS | METH_KEYWORDS, PPCDecoder_decode_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,               reduce_cannot_pickle_doc},
+                             METH_FASTCALL | METH_KEYWORDS, PPCDecoder_decode_doc},
+        {"flush",      (PyCFunction) BCJDecoder_flush,
+                             METH_NOARGS,                  BCJDecoder_flush_doc},
+        {"decode_to",  (PyCFunction) BCJDecoder_decode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_to_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                         NULL}
 };
 
 static PyType_Slot PPCDecoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    PPCDecoder_init},
+        {Py_tp_init,    PPCDecoder_tp_init},
         {Py_tp_methods, PPCDecoder_methods},
+        {Py_tp_getset, BCJDecoder_getset},
         {0,             0}
 };
 
 static PyType_Spec PPCDecoder_type_spec = {
-        .name = "_bcj.PPCDecoder",
+        .name = "bcj._bcj.PPCDecoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = PPCDecoder_slots,
@@ -1063,24 +2982,40 @@ static PyType_Spec PPCDecoder_type_spec = {
 /* IA64 encoder */
 static PyMethodDef IA64Encoder_methods[] = {
         {"encode",     (PyCFunction) IA64Encoder_encode,
-                             METH_VARARGS | METH_KEYWORDS, IA64Encoder_encode_doc},
+                             METH_FASTCALL | METH_KEYWORDS, IA64Encoder_encode_doc},
+        {"encode_to",  (PyCFunction) BCJEncoder_encode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_to_doc},
         {"flush",     (PyCFunction) IA64Encoder_flush,
-                             METH_VARARGS | METH_KEYWORDS,  IA64Encoder_flush_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                reduce_cannot_pickle_doc},
+                             METH_NOARGS,  IA64Encoder_flush_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                          NULL}
 };
 
 static PyType_Slot IA64Encoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    IA64Encoder_init},
+        {Py_tp_init,    IA64Encoder_tp_init},
         {Py_tp_methods, IA64Encoder_methods},
         {0,             0}
 };
 
 static PyType_Spec IA64Encoder_type_spec = {
-        .name = "_bcj.IA64Encoder",
+        .name = "bcj._bcj.IA64Encoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = IA64Encoder_slots,
@@ -1089,22 +3024,41 @@ static PyType_Spec IA64Encoder_type_spec = {
 /* IA64Decoder */
 static PyMethodDef IA64Decoder_methods[] = {
         {"decode",     (PyCFunction) IA64Decoder_decode,
-                             METH_VARARGS | METH_KEYWORDS, IA64Decoder_decode_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                reduce_cannot_pickle_doc},
+                             METH_FASTCALL | METH_KEYWORDS, IA64Decoder_decode_doc},
+        {"flush",      (PyCFunction) BCJDecoder_flush,
+                             METH_NOARGS,                  BCJDecoder_flush_doc},
+        {"decode_to",  (PyCFunction) BCJDecoder_decode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_to_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                            NULL}
 };
 
 static PyType_Slot IA64Decoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    IA64Decoder_init},
+        {Py_tp_init,    IA64Decoder_tp_init},
         {Py_tp_methods, IA64Decoder_methods},
+        {Py_tp_getset, BCJDecoder_getset},
         {0,             0}
 };
 
 static PyType_Spec IA64Decoder_type_spec = {
-        .name = "_bcj.IA64Decoder",
+        .name = "bcj._bcj.IA64Decoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = IA64Decoder_slots,
@@ -1113,24 +3067,40 @@ static PyType_Spec IA64Decoder_type_spec = {
 /* Sparc encoder */
 static PyMethodDef SparcEncoder_methods[] = {
         {"encode",     (PyCFunction) SparcEncoder_encode,
-                             METH_VARARGS | METH_KEYWORDS, SparcEncoder_encode_doc},
+                             METH_FASTCALL | METH_KEYWORDS, SparcEncoder_encode_doc},
+        {"encode_to",  (PyCFunction) BCJEncoder_encode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJEncoder_encode_to_doc},
         {"flush",     (PyCFunction) SparcEncoder_flush,
-                             METH_VARARGS | METH_KEYWORDS,  SparcEncoder_flush_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                reduce_cannot_pickle_doc},
+                             METH_NOARGS,  SparcEncoder_flush_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                          NULL}
 };
 
 static PyType_Slot SparcEncoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    SparcEncoder_init},
+        {Py_tp_init,    SparcEncoder_tp_init},
         {Py_tp_methods, SparcEncoder_methods},
         {0,             0}
 };
 
 static PyType_Spec SparcEncoder_type_spec = {
-        .name = "_bcj.SparcEncoder",
+        .name = "bcj._bcj.SparcEncoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = SparcEncoder_slots,
@@ -1139,32 +3109,247 @@ static PyType_Spec SparcEncoder_type_spec = {
 /* IA64Decoder */
 static PyMethodDef SparcDecoder_methods[] = {
         {"decode",     (PyCFunction) SparcDecoder_decode,
-                             METH_VARARGS | METH_KEYWORDS, SparcDecoder_decode_doc},
-        {"__reduce__", (PyCFunction) reduce_cannot_pickle,
-                             METH_NOARGS,                reduce_cannot_pickle_doc},
+                             METH_FASTCALL | METH_KEYWORDS, SparcDecoder_decode_doc},
+        {"flush",      (PyCFunction) BCJDecoder_flush,
+                             METH_NOARGS,                  BCJDecoder_flush_doc},
+        {"decode_to",  (PyCFunction) BCJDecoder_decode_to,
+                             METH_FASTCALL | METH_KEYWORDS, BCJDecoder_decode_to_doc},
+        {"digest",     (PyCFunction) BCJFilter_digest,
+                             METH_NOARGS,                  BCJFilter_digest_doc},
+        {"checkpoints", (PyCFunction) BCJFilter_checkpoints,
+                             METH_NOARGS,                  BCJFilter_checkpoints_doc},
+        {"reset",      (PyCFunction) BCJFilter_reset,
+                             METH_FASTCALL | METH_KEYWORDS, BCJFilter_reset_doc},
+        {"copy",       (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__copy__",   (PyCFunction) BCJFilter_copy,
+                             METH_NOARGS,                  BCJFilter_copy_doc},
+        {"__deepcopy__", (PyCFunction) BCJFilter_deepcopy,
+                             METH_O,                       BCJFilter_copy_doc},
+        {"__reduce__", (PyCFunction) BCJFilter_reduce,
+                             METH_NOARGS,                  BCJFilter_reduce_doc},
+        {"__setstate__", (PyCFunction) BCJFilter_setstate,
+                             METH_O,                       BCJFilter_setstate_doc},
         {NULL,         NULL, 0,                            NULL}
 };
 
 static PyType_Slot SparcDecoder_slots[] = {
         {Py_tp_new,     BCJFilter_new},
         {Py_tp_dealloc, BCJFilter_dealloc},
-        {Py_tp_init,    SparcDecoder_init},
+        {Py_tp_init,    SparcDecoder_tp_init},
         {Py_tp_methods, SparcDecoder_methods},
+        {Py_tp_getset, BCJDecoder_getset},
         {0,             0}
 };
 
 static PyType_Spec SparcDecoder_type_spec = {
-        .name = "_bcj.SparcDecoder",
+        .name = "bcj._bcj.SparcDecoder",
         .basicsize = sizeof(BCJFilter),
         .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
         .slots = SparcDecoder_slots,
 };
 
+/* --------------------
+     Module functions
+   -------------------- */
+
+/* Names of architectures for pipe(), indexed by Method */
+static const char *const archNames[] = {"x86", "arm", "armt", "ppc", "sparc", "ia64", "arm64", NULL};
+
+/* Find arch in archNames. Returns -1 with ValueError when it is unknown. */
+static int
+_bcj_arch(const char *archName) {
+    for (int arch = 0; archNames[arch] != NULL; arch++) {
+        if (strcmp(archNames[arch], archName) == 0) {
+            return arch;
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "unknown arch '%s'.", archName);
+    return -1;
+}
+
+PyDoc_STRVAR(_bcj_pipe_doc,
+"pipe(src_fd, dst_fd, arch, *, encode=True, start_offset=0, state=0, block_size=1048576, blocks=4)\n"
+"----\n"
+"Filter everything read from src_fd into dst_fd, and return the number of bytes written.\n"
+"arch is one of 'x86', 'arm', 'armt', 'ppc', 'sparc', 'ia64' and 'arm64'.\n"
+"Reading, conversion and writing run in separate threads over a ring of blocks,\n"
+"without the GIL. The end of the stream is flushed.");
+
+static PyObject *
+_bcj_pipe(PyObject *module, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"src_fd", "dst_fd", "arch", "encode", "start_offset", "state",
+                             "block_size", "blocks", NULL};
+    int srcFd, dstFd;
+    const char *archName;
+    int encode = 1;
+    unsigned long long startOffset = 0;
+    unsigned long long state = 0;
+    Py_ssize_t blockSize = BCJ_PIPE_BLOCK_SIZE_DEFAULT;
+    int blocks = BCJ_PIPE_BLOCKS_DEFAULT;
+    UInt64 written = 0;
+    int arch, err;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
+                                     "iis|$pO&O&ni:pipe", kwlist,
+                                     &srcFd, &dstFd, &archName, &encode,
+                                     BCJArg_range_converter, &startOffset, BCJArg_range_converter, &state,
+                                     &blockSize, &blocks)) {
+        return NULL;
+    }
+    if ((arch = _bcj_arch(archName)) < 0) {
+        return NULL;
+    }
+    if (srcFd < 0 || dstFd < 0) {
+        PyErr_SetString(PyExc_ValueError, "file descriptor should be a non-negative int.");
+        return NULL;
+    }
+    if (state > 7 || (state != 0 && arch != x86)) {
+        PyErr_SetString(PyExc_ValueError, invalid_state_msg);
+        return NULL;
+    }
+    if (BCJFilter_check_start_offset(arch, startOffset) < 0) {
+        return NULL;
+    }
+    if (blockSize <= 0 || blocks < 2) {
+        PyErr_SetString(PyExc_ValueError, "block_size should be positive and blocks at least 2.");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    err = BCJ_Pipe(srcFd, dstFd, arch, encode, (UInt32) startOffset, (UInt32) state,
+                   (SizeT) blockSize, (unsigned) blocks, &written);
+    Py_END_ALLOW_THREADS
+    if (err != 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return PyLong_FromUnsignedLongLong(written);
+}
+
+/* Names of engines for filter_file(), indexed by BCJFileEngine */
+static const char *const engineNames[] = {"auto", "io_uring", "pread", NULL};
+
+PyDoc_STRVAR(_bcj_filter_file_doc,
+"filter_file(src, dst, arch, *, encode=True, start_offset=0, state=0, block_size=1048576,\n"
+"            queue_depth=8, direct=False, engine='auto')\n"
+"----\n"
+"Filter the regular file src into a new file dst, and return the number of bytes written.\n"
+"queue_depth aligned blocks are in flight; each completed block is converted while the next\n"
+"ones are loading, on the calling thread only. engine is 'io_uring', 'pread' for pread/pwrite,\n"
+"or 'auto' for io_uring when the kernel has it. direct=True reads src with O_DIRECT\n"
+"where the file system supports it.");
+
+static PyObject *
+_bcj_filter_file(PyObject *module, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"src", "dst", "arch", "encode", "start_offset", "state", "block_size",
+                             "queue_depth", "direct", "engine", NULL};
+    PyObject *srcPath, *dstPath;
+    PyObject *src = NULL;
+    PyObject *dst = NULL;
+    PyObject *failed = NULL;
+    const char *archName;
+    int encode = 1;
+    unsigned long long startOffset = 0;
+    unsigned long long state = 0;
+    Py_ssize_t blockSize = BCJ_PIPE_BLOCK_SIZE_DEFAULT;
+    int depth = BCJ_FILE_QUEUE_DEPTH_DEFAULT;
+    int direct = 0;
+    const char *engineName = "auto";
+    UInt64 written = 0;
+    int arch, engine, srcFd = -1, dstFd = -1, err = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs,
+                                     "OOs|$pO&O&nipz:filter_file", kwlist,
+                                     &srcPath, &dstPath, &archName,
+                                     &encode, BCJArg_range_converter, &startOffset, BCJArg_range_converter, &state,
+                                     &blockSize, &depth, &direct, &engineName)) {
+        return NULL;
+    }
+    if (!PyUnicode_FSConverter(srcPath, &src) || !PyUnicode_FSConverter(dstPath, &dst)) {
+        goto error;
+    }
+    if ((arch = _bcj_arch(archName)) < 0) {
+        goto error;
+    }
+    for (engine = 0; engineNames[engine] != NULL; engine++) {
+        if (strcmp(engineNames[engine], engineName) == 0) {
+            break;
+        }
+    }
+    if (engineNames[engine] == NULL) {
+        PyErr_Format(PyExc_ValueError, "unknown engine '%s'.", engineName);
+        goto error;
+    }
+    if (state > 7 || (state != 0 && arch != x86)) {
+        PyErr_SetString(PyExc_ValueError, invalid_state_msg);
+        goto error;
+    }
+    if (BCJFilter_check_start_offset(arch, startOffset) < 0) {
+        goto error;
+    }
+    if (blockSize <= 0 || depth < 2) {
+        PyErr_SetString(PyExc_ValueError, "block_size should be positive and queue_depth at least 2.");
+        goto error;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+#ifdef O_DIRECT
+    if (direct) {
+        srcFd = BCJ_OPEN(PyBytes_AS_STRING(src), O_RDONLY | O_DIRECT, 0);
+        if (srcFd < 0 && errno == EINVAL) {
+            // the file system does not support O_DIRECT
+            direct = 0;
+        }
+    }
+#else
+    direct = 0;
+#endif
+    if (srcFd < 0) {
+        srcFd = BCJ_OPEN(PyBytes_AS_STRING(src), O_RDONLY, 0);
+    }
+    if (srcFd >= 0) {
+        dstFd = BCJ_OPEN(PyBytes_AS_STRING(dst), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    if (srcFd < 0 || dstFd < 0) {
+        err = errno;
+        failed = srcFd < 0 ? srcPath : dstPath;
+    } else {
+        err = BCJ_FileFilter(srcFd, dstFd, arch, encode, (UInt32) startOffset, (UInt32) state,
+                             (SizeT) blockSize, (unsigned) depth, engine, direct, &written);
+    }
+    if (dstFd >= 0) {
+        BCJ_CLOSE(dstFd);
+    }
+    if (srcFd >= 0) {
+        BCJ_CLOSE(srcFd);
+    }
+    Py_END_ALLOW_THREADS
+    if (err != 0) {
+        errno = err;
+        if (failed != NULL) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, failed);
+        } else {
+            PyErr_SetFromErrno(PyExc_OSError);
+        }
+        goto error;
+    }
+    Py_DECREF(src);
+    Py_DECREF(dst);
+    return PyLong_FromUnsignedLongLong(written);
+
+    error:
+    Py_XDECREF(src);
+    Py_XDECREF(dst);
+    return NULL;
+}
+
 /* --------------------
      Initialize code
    -------------------- */
 
 static PyMethodDef _bcj_methods[] = {
+        {"pipe", (PyCFunction) _bcj_pipe, METH_VARARGS | METH_KEYWORDS, _bcj_pipe_doc},
+        {"filter_file", (PyCFunction) _bcj_filter_file, METH_VARARGS | METH_KEYWORDS, _bcj_filter_file_doc},
         {NULL}
 };
 
@@ -1176,6 +3361,8 @@ typedef struct {
     PyTypeObject *ARMDecoder_type;
     PyTypeObject *ARMTEncoder_type;
     PyTypeObject *ARMTDecoder_type;
+    PyTypeObject *ARM64Encoder_type;
+    PyTypeObject *ARM64Decoder_type;
     PyTypeObject *PPCEncoder_type;
     PyTypeObject *PPCDecoder_type;
     PyTypeObject *IA64Encoder_type;
@@ -1184,167 +3371,217 @@ typedef struct {
     PyTypeObject *SparcDecoder_type;
 } _bcj_state;
 
-static _bcj_state static_state;
+static inline _bcj_state *
+get_bcj_state(PyObject *module) {
+    return (_bcj_state *) PyModule_GetState(module);
+}
 
 static int
 _bcj_traverse(PyObject *module, visitproc visit, void *arg) {
-    Py_VISIT(static_state.BCJEncoder_type);
-    Py_VISIT(static_state.BCJDecoder_type);
-    Py_VISIT(static_state.ARMEncoder_type);
-    Py_VISIT(static_state.ARMDecoder_type);
-    Py_VISIT(static_state.ARMTEncoder_type);
-    Py_VISIT(static_state.ARMTDecoder_type);
-    Py_VISIT(static_state.PPCEncoder_type);
-    Py_VISIT(static_state.PPCDecoder_type);
-    Py_VISIT(static_state.IA64Encoder_type);
-    Py_VISIT(static_state.IA64Decoder_type);
-    Py_VISIT(static_state.SparcEncoder_type);
-    Py_VISIT(static_state.SparcDecoder_type);
+    _bcj_state *state = get_bcj_state(module);
+    Py_VISIT(state->BCJEncoder_type);
+    Py_VISIT(state->BCJDecoder_type);
+    Py_VISIT(state->ARMEncoder_type);
+    Py_VISIT(state->ARMDecoder_type);
+    Py_VISIT(state->ARMTEncoder_type);
+    Py_VISIT(state->ARMTDecoder_type);
+    Py_VISIT(state->ARM64Encoder_type);
+    Py_VISIT(state->ARM64Decoder_type);
+    Py_VISIT(state->PPCEncoder_type);
+    Py_VISIT(state->PPCDecoder_type);
+    Py_VISIT(state->IA64Encoder_type);
+    Py_VISIT(state->IA64Decoder_type);
+    Py_VISIT(state->SparcEncoder_type);
+    Py_VISIT(state->SparcDecoder_type);
     return 0;
 }
 
 static int
 _bcj_clear(PyObject *module) {
-    Py_CLEAR(static_state.BCJEncoder_type);
-    Py_CLEAR(static_state.BCJDecoder_type);
-    Py_CLEAR(static_state.ARMEncoder_type);
-    Py_CLEAR(static_state.ARMDecoder_type);
-    Py_CLEAR(static_state.ARMTEncoder_type);
-    Py_CLEAR(static_state.ARMTDecoder_type);
-    Py_CLEAR(static_state.PPCEncoder_type);
-    Py_CLEAR(static_state.PPCDecoder_type);
-    Py_CLEAR(static_state.IA64Encoder_type);
-    Py_CLEAR(static_state.IA64Encoder_type);
-    Py_CLEAR(static_state.SparcDecoder_type);
-    Py_CLEAR(static_state.SparcDecoder_type);
+    _bcj_state *state = get_bcj_state(module);
+    Py_CLEAR(state->BCJEncoder_type);
+    Py_CLEAR(state->BCJDecoder_type);
+    Py_CLEAR(state->ARMEncoder_type);
+    Py_CLEAR(state->ARMDecoder_type);
+    Py_CLEAR(state->ARMTEncoder_type);
+    Py_CLEAR(state->ARMTDecoder_type);
+    Py_CLEAR(state->ARM64Encoder_type);
+    Py_CLEAR(state->ARM64Decoder_type);
+    Py_CLEAR(state->PPCEncoder_type);
+    Py_CLEAR(state->PPCDecoder_type);
+    Py_CLEAR(state->IA64Encoder_type);
+    Py_CLEAR(state->IA64Decoder_type);
+    Py_CLEAR(state->SparcEncoder_type);
+    Py_CLEAR(state->SparcDecoder_type);
     return 0;
 }
 
 static void
 _bcj_free(void *module) {
     _bcj_clear((PyObject *) module);
+    BCJArena_trim();
 }
 
-static PyModuleDef _bcjmodule = {
-        PyModuleDef_HEAD_INIT,
-        .m_name = "_bcj",
-        .m_size = -1,
-        .m_methods = _bcj_methods,
-        .m_traverse = _bcj_traverse,
-        .m_clear = _bcj_clear,
-        .m_free = _bcj_free
-};
-
-
 static inline int
 add_type_to_module(PyObject *module, const char *name,
-                   PyType_Spec *type_spec, PyTypeObject **dest) {
+                   PyType_Spec *type_spec, vectorcallfunc vectorcall, PyTypeObject **dest) {
     PyObject *temp;
 
-    temp = PyType_FromSpec(type_spec);
-    if (PyModule_AddObject(module, name, temp) < 0) {
-        Py_XDECREF(temp);
+    temp = PyType_FromModuleAndSpec(module, type_spec, NULL);
+    if (temp == NULL) {
+        return -1;
+    }
+    // there is no slot for it before Python 3.14
+    ((PyTypeObject *) temp)->tp_vectorcall = vectorcall;
+    if (PyModule_AddObjectRef(module, name, temp) < 0) {
+        Py_DECREF(temp);
         return -1;
     }
 
-    Py_INCREF(temp);
     *dest = (PyTypeObject *) temp;
 
     return 0;
 }
 
-PyMODINIT_FUNC
-PyInit__bcj(void) {
-    PyObject *module;
+static int
+_bcj_exec(PyObject *module) {
+    _bcj_state *state = get_bcj_state(module);
 
-    module = PyModule_Create(&_bcjmodule);
-    if (!module) {
-        goto error;
-    }
+    // the tables are built by the first interpreter only
+    CrcGenerateTable();
 
     if (add_type_to_module(module,
                            "BCJEncoder",
                            &BCJEncoder_type_spec,
-                           &static_state.BCJEncoder_type) < 0) {
-        goto error;
+                           BCJEncoder_vectorcall,
+                           &state->BCJEncoder_type) < 0) {
+        return -1;
     }
     if (add_type_to_module(module,
                            "BCJDecoder",
                            &BCJDecoder_type_spec,
-                           &static_state.BCJDecoder_type) < 0) {
-        goto error;
+                           BCJDecoder_vectorcall,
+                           &state->BCJDecoder_type) < 0) {
+        return -1;
     }
 
     if (add_type_to_module(module,
                            "ARMEncoder",
                            &ARMEncoder_type_spec,
-                           &static_state.ARMEncoder_type) < 0) {
-        goto error;
+                           ARMEncoder_vectorcall,
+                           &state->ARMEncoder_type) < 0) {
+        return -1;
     }
     if (add_type_to_module(module,
                            "ARMDecoder",
                            &ARMDecoder_type_spec,
-                           &static_state.ARMDecoder_type) < 0) {
-        goto error;
+                           ARMDecoder_vectorcall,
+                           &state->ARMDecoder_type) < 0) {
+        return -1;
     }
 
     if (add_type_to_module(module,
                            "ARMTEncoder",
                            &ARMTEncoder_type_spec,
-                           &static_state.ARMTEncoder_type) < 0) {
-        goto error;
+                           ARMTEncoder_vectorcall,
+                           &state->ARMTEncoder_type) < 0) {
+        return -1;
     }
     if (add_type_to_module(module,
                            "ARMTDecoder",
                            &ARMTDecoder_type_spec,
-                           &static_state.ARMTDecoder_type) < 0) {
-        goto error;
+                           ARMTDecoder_vectorcall,
+                           &state->ARMTDecoder_type) < 0) {
+        return -1;
+    }
+
+    if (add_type_to_module(module,
+                           "ARM64Encoder",
+                           &ARM64Encoder_type_spec,
+                           ARM64Encoder_vectorcall,
+                           &state->ARM64Encoder_type) < 0) {
+        return -1;
+    }
+    if (add_type_to_module(module,
+                           "ARM64Decoder",
+                           &ARM64Decoder_type_spec,
+                           ARM64Decoder_vectorcall,
+                           &state->ARM64Decoder_type) < 0) {
+        return -1;
     }
 
     if (add_type_to_module(module,
                            "PPCEncoder",
                            &PPCEncoder_type_spec,
-                           &static_state.PPCEncoder_type) < 0) {
-        goto error;
+                           PPCEncoder_vectorcall,
+                           &state->PPCEncoder_type) < 0) {
+        return -1;
     }
     if (add_type_to_module(module,
                            "PPCDecoder",
                            &PPCDecoder_type_spec,
-                           &static_state.PPCDecoder_type) < 0) {
-        goto error;
+                           PPCDecoder_vectorcall,
+                           &state->PPCDecoder_type) < 0) {
+        return -1;
     }
 
     if (add_type_to_module(module,
                            "IA64Encoder",
                            &IA64Encoder_type_spec,
-                           &static_state.IA64Encoder_type) < 0) {
-        goto error;
+                           IA64Encoder_vectorcall,
+                           &state->IA64Encoder_type) < 0) {
+        return -1;
     }
     if (add_type_to_module(module,
                            "IA64Decoder",
                            &IA64Decoder_type_spec,
-                           &static_state.IA64Decoder_type) < 0) {
-        goto error;
+                           IA64Decoder_vectorcall,
+                           &state->IA64Decoder_type) < 0) {
+        return -1;
     }
 
     if (add_type_to_module(module,
                            "SparcEncoder",
                            &SparcEncoder_type_spec,
-                           &static_state.SparcEncoder_type) < 0) {
-        goto error;
+                           SparcEncoder_vectorcall,
+                           &state->SparcEncoder_type) < 0) {
+        return -1;
     }
     if (add_type_to_module(module,
                            "SparcDecoder",
                            &SparcDecoder_type_spec,
-                           &static_state.SparcDecoder_type) < 0) {
-        goto error;
+                           SparcDecoder_vectorcall,
+                           &state->SparcDecoder_type) < 0) {
+        return -1;
     }
 
-    return module;
+    return 0;
+}
+
+static PyModuleDef_Slot _bcj_slots[] = {
+        {Py_mod_exec, _bcj_exec},
+#ifdef Py_mod_multiple_interpreters
+        {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+        // filter objects are guarded by their own locks, and module functions keep no shared state
+        {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+        {0, NULL}
+};
 
-    error:
-    _bcj_clear(NULL);
-    Py_XDECREF(module);
+static PyModuleDef _bcjmodule = {
+        PyModuleDef_HEAD_INIT,
+        .m_name = "_bcj",
+        .m_size = sizeof(_bcj_state),
+        .m_methods = _bcj_methods,
+        .m_slots = _bcj_slots,
+        .m_traverse = _bcj_traverse,
+        .m_clear = _bcj_clear,
+        .m_free = _bcj_free
+};
 
-    return NULL;
+PyMODINIT_FUNC
+PyInit__bcj(void) {
+    return PyModuleDef_Init(&_bcjmodule);
 }
@@ -0,0 +1,194 @@
+/**
+ * libbcj: branch converters of PyBcj as a C library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Bra.h"
+#include "Pipe.h"
+#include "bcj.h"
+
+/* BCJ_Convert of Pipe.h takes the same architecture numbers */
+#define BCJ_ARCH_MATCHES(name) ((int) BCJ_ARCH_##name == (int) BCJ_PIPE_##name)
+typedef char BCJArchMatchesPipe[BCJ_ARCH_MATCHES(X86) && BCJ_ARCH_MATCHES(ARM) && BCJ_ARCH_MATCHES(ARMT) &&
+                                BCJ_ARCH_MATCHES(PPC) && BCJ_ARCH_MATCHES(SPARC) && BCJ_ARCH_MATCHES(IA64) &&
+                                BCJ_ARCH_MATCHES(ARM64) ? 1 : -1];
+
+/* Bytes of new data joined with the carry bytes, larger than any converter window. */
+#define BCJ_STITCH_SIZE 32
+
+struct BCJContext {
+    int arch;
+    int encoding;
+    UInt32 ip;
+    UInt32 state;
+    uint64_t position;
+    Byte carry[BCJ_CARRY_MAX + BCJ_STITCH_SIZE];
+    SizeT carrySize;
+};
+
+unsigned
+BCJ_VersionNumber(void) {
+    return BCJ_VERSION_NUMBER;
+}
+
+const char *
+BCJ_VersionString(void) {
+    return BCJ_VERSION_STRING;
+}
+
+static int
+BCJ_CheckArgs(int arch, int encoding, uint32_t startOffset, uint32_t state) {
+    if (arch < BCJ_ARCH_X86 || arch > BCJ_ARCH_ARM64 || (encoding != BCJ_DECODE && encoding != BCJ_ENCODE) ||
+        startOffset % BCJ_Alignment(arch) != 0 || state > 7 || (state != 0 && arch != BCJ_ARCH_X86)) {
+        return EINVAL;
+    }
+    return 0;
+}
+
+int
+BCJ_ContextCreate(BCJContext **ctx, int arch, int encoding, uint32_t startOffset, uint32_t state) {
+    int err = BCJ_CheckArgs(arch, encoding, startOffset, state);
+    if (err != 0) {
+        return err;
+    }
+    *ctx = malloc(sizeof(BCJContext));
+    if (*ctx == NULL) {
+        return ENOMEM;
+    }
+    (*ctx)->arch = arch;
+    (*ctx)->encoding = encoding;
+    return BCJ_ContextReset(*ctx, startOffset, state);
+}
+
+void
+BCJ_ContextDestroy(BCJContext *ctx) {
+    free(ctx);
+}
+
+int
+BCJ_ContextReset(BCJContext *ctx, uint32_t startOffset, uint32_t state) {
+    int err = BCJ_CheckArgs(ctx->arch, ctx->encoding, startOffset, state);
+    if (err != 0) {
+        return err;
+    }
+    ctx->ip = startOffset;
+    ctx->state = state;
+    ctx->position = 0;
+    ctx->carrySize = 0;
+    return 0;
+}
+
+/* Convert src into dest with the copy converter; only the processed bytes of dest are written. */
+static SizeT
+BCJContext_convert_copy(BCJContext *ctx, const Byte *src, Byte *dest, SizeT size) {
+    SizeT outLen;
+
+    switch (ctx->arch) {
+        case BCJ_ARCH_X86:
+            outLen = x86_Convert_Copy(src, dest, size, ctx->ip, &ctx->state, ctx->encoding);
+            break;
+        case BCJ_ARCH_ARM:
+            outLen = ARM_Convert_Copy(src, dest, size, ctx->ip, ctx->encoding);
+            break;
+        case BCJ_ARCH_ARMT:
+            outLen = ARMT_Convert_Copy(src, dest, size, ctx->ip, ctx->encoding);
+            break;
+        case BCJ_ARCH_PPC:
+            outLen = PPC_Convert_Copy(src, dest, size, ctx->ip, ctx->encoding);
+            break;
+        case BCJ_ARCH_SPARC:
+            outLen = SPARC_Convert_Copy(src, dest, size, ctx->ip, ctx->encoding);
+            break;
+        case BCJ_ARCH_IA64:
+            outLen = IA64_Convert_Copy(src, dest, size, ctx->ip, ctx->encoding);
+            break;
+        case BCJ_ARCH_ARM64:
+            outLen = ARM64_Convert_Copy(src, dest, size, ctx->ip, ctx->encoding);
+            break;
+        default:
+            // should not come here.
+            return 0;
+    }
+    ctx->ip += (UInt32) outLen;
+    return outLen;
+}
+
+/* Convert the carry bytes in place. */
+static SizeT
+BCJContext_convert_carry(BCJContext *ctx) {
+    SizeT outLen = BCJ_Convert(ctx->arch, ctx->carry, ctx->carrySize, ctx->ip, &ctx->state, ctx->encoding);
+    ctx->ip += (UInt32) outLen;
+    return outLen;
+}
+
+size_t
+BCJ_ContextUpdate(BCJContext *ctx, const uint8_t *in, size_t inSize, uint8_t *out) {
+    SizeT outLen = 0;
+
+    ctx->position += inSize;
+    if (ctx->carrySize > 0) {
+        // join carry and head of the input, then convert across the boundary
+        SizeT carrySize = ctx->carrySize;
+        SizeT headSize = inSize < BCJ_STITCH_SIZE ? inSize : BCJ_STITCH_SIZE;
+        memcpy(ctx->carry + carrySize, in, headSize);
+        ctx->carrySize += headSize;
+        outLen = BCJContext_convert_carry(ctx);
+        memcpy(out, ctx->carry, outLen);
+        if (outLen < carrySize) {
+            // too short to go over the carry; the rest is kept
+            ctx->carrySize -= outLen;
+            memmove(ctx->carry, ctx->carry + outLen, ctx->carrySize);
+            return outLen;
+        }
+        in += outLen - carrySize;
+        inSize -= outLen - carrySize;
+        ctx->carrySize = 0;
+    }
+    SizeT len = BCJContext_convert_copy(ctx, in, out + outLen, inSize);
+    // keep the tail as carry data
+    ctx->carrySize = inSize - len;
+    memcpy(ctx->carry, in + len, ctx->carrySize);
+    return outLen + len;
+}
+
+size_t
+BCJ_ContextFinish(BCJContext *ctx, uint8_t *out) {
+    SizeT size = ctx->carrySize;
+
+    BCJContext_convert_carry(ctx);
+    // all the rest goes through
+    memcpy(out, ctx->carry, size);
+    ctx->carrySize = 0;
+    return size;
+}
+
+uint64_t
+BCJ_ContextPosition(const BCJContext *ctx) {
+    return ctx->position;
+}
+
+static int
+BCJ_Buffer(int arch, int encoding, uint32_t startOffset, uint8_t *data, size_t size) {
+    UInt32 state = 0;
+    int err = BCJ_CheckArgs(arch, encoding, startOffset, state);
+    if (err != 0) {
+        return err;
+    }
+    // the tail that is not converted is the same as Finish passes through
+    BCJ_Convert(arch, data, size, startOffset, &state, encoding);
+    return 0;
+}
+
+int
+BCJ_Encode(int arch, uint32_t startOffset, uint8_t *data, size_t size) {
+    return BCJ_Buffer(arch, BCJ_ENCODE, startOffset, data, size);
+}
+
+int
+BCJ_Decode(int arch, uint32_t startOffset, uint8_t *data, size_t size) {
+    return BCJ_Buffer(arch, BCJ_DECODE, startOffset, data, size);
+}
@@ -0,0 +1,109 @@
+/**
+ * libbcj: branch converters of PyBcj as a C library.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef BCJ_H
+#define BCJ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BCJ_VERSION_MAJOR 1
+#define BCJ_VERSION_MINOR 2
+#define BCJ_VERSION_PATCH 0
+#define BCJ_VERSION_STRING "1.2.0"
+/* MMmmpp, e.g. 10200 for 1.2.0 */
+#define BCJ_VERSION_NUMBER (BCJ_VERSION_MAJOR * 10000 + BCJ_VERSION_MINOR * 100 + BCJ_VERSION_PATCH)
+
+#if defined(_WIN32) && defined(BCJ_DLL)
+#ifdef BCJ_BUILD
+#define BCJ_API __declspec(dllexport)
+#else
+#define BCJ_API __declspec(dllimport)
+#endif
+#elif defined(BCJ_BUILD) && defined(__GNUC__)
+#define BCJ_API __attribute__((visibility("default")))
+#else
+#define BCJ_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Architectures, the same values as the filters of the Python module */
+enum BCJArch {
+    BCJ_ARCH_X86,
+    BCJ_ARCH_ARM,
+    BCJ_ARCH_ARMT,
+    BCJ_ARCH_PPC,
+    BCJ_ARCH_SPARC,
+    BCJ_ARCH_IA64,
+    BCJ_ARCH_ARM64
+};
+
+#define BCJ_DECODE 0
+#define BCJ_ENCODE 1
+
+/* A context never keeps more carry bytes than this. */
+#define BCJ_CARRY_MAX 16
+
+/* Size of out that BCJ_ContextUpdate needs for inSize bytes of input. */
+#define BCJ_UPDATE_BOUND(inSize) ((inSize) + BCJ_CARRY_MAX)
+
+/* Version of the library actually linked, BCJ_VERSION_NUMBER and BCJ_VERSION_STRING of it. */
+BCJ_API unsigned BCJ_VersionNumber(void);
+BCJ_API const char *BCJ_VersionString(void);
+
+/*
+A streaming context, the C counterpart of the encoder and decoder objects of
+the Python module. The last bytes of each input that may start a branch are kept
+as carry data and converted together with the next input, so a stream gives the
+same result however it is split.
+A context is not thread safe; use one context for each stream.
+*/
+typedef struct BCJContext BCJContext;
+
+/*
+Create a context. start_offset is the virtual address of the first byte of the
+stream, a multiple of the instruction alignment: 2 for ARMT, 4 for ARM, ARM64,
+PPC and SPARC, 16 for IA64. state is the x86 converter state and should be 0
+for other architectures. Returns 0 and sets *ctx, or EINVAL or ENOMEM.
+*/
+BCJ_API int BCJ_ContextCreate(BCJContext **ctx, int arch, int encoding, uint32_t startOffset, uint32_t state);
+
+BCJ_API void BCJ_ContextDestroy(BCJContext *ctx);
+
+/* Start a new stream; carry data is dropped. Returns 0 or EINVAL. */
+BCJ_API int BCJ_ContextReset(BCJContext *ctx, uint32_t startOffset, uint32_t state);
+
+/*
+Convert in into out and return the number of bytes written to out.
+out should have room for BCJ_UPDATE_BOUND(inSize) bytes and must not overlap in.
+The unconverted tail is kept in the context.
+*/
+BCJ_API size_t BCJ_ContextUpdate(BCJContext *ctx, const uint8_t *in, size_t inSize, uint8_t *out);
+
+/*
+End the stream: convert the carry data, pass through what cannot be converted,
+and write it to out, which should have room for BCJ_CARRY_MAX bytes.
+Returns the number of bytes written. The context should be reset to be used again.
+*/
+BCJ_API size_t BCJ_ContextFinish(BCJContext *ctx, uint8_t *out);
+
+/* Number of bytes given to BCJ_ContextUpdate since the start of the stream. */
+BCJ_API uint64_t BCJ_ContextPosition(const BCJContext *ctx);
+
+/*
+Convert a whole stream in place in one call, the same as Update and Finish
+over the data. Returns 0, or EINVAL for the same arguments as BCJ_ContextCreate.
+*/
+BCJ_API int BCJ_Encode(int arch, uint32_t startOffset, uint8_t *data, size_t size);
+BCJ_API int BCJ_Decode(int arch, uint32_t startOffset, uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
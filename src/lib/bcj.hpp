@@ -0,0 +1,507 @@
+/**
+ * libbcj: header-only C++ interface of the branch converters.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * bcj::Filter<Arch, Direction> is a streaming filter whose architecture and
+ * direction are template parameters, so each instantiation compiles to its own
+ * kernel without tests of the direction inside the loops. The results are the
+ * same as the C converters and the Python module. Needs C++17; with C++20
+ * std::span overloads are available too.
+ */
+#ifndef BCJ_HPP
+#define BCJ_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(_MSVC_LANG) && _MSVC_LANG > __cplusplus
+#define BCJ_CPLUSPLUS _MSVC_LANG
+#else
+#define BCJ_CPLUSPLUS __cplusplus
+#endif
+#if BCJ_CPLUSPLUS >= 202002L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#define BCJ_HAS_SPAN 1
+#endif
+#endif
+
+namespace bcj {
+
+/* The same values as BCJArch of bcj.h */
+enum class Arch { x86, arm, armt, ppc, sparc, ia64, arm64 };
+
+enum class Direction { decode, encode };
+
+/* A filter never keeps more carry bytes than this. */
+inline constexpr std::size_t carry_max = 16;
+
+namespace detail {
+
+template <Direction D>
+constexpr std::uint32_t apply(std::uint32_t v, std::uint32_t cur) {
+    if constexpr (D == Direction::encode) {
+        return v + cur;
+    } else {
+        return v - cur;
+    }
+}
+
+inline std::uint32_t get_le32(const std::uint8_t *p) {
+    return (std::uint32_t) p[0] | ((std::uint32_t) p[1] << 8) | ((std::uint32_t) p[2] << 16) |
+           ((std::uint32_t) p[3] << 24);
+}
+
+inline void set_le32(std::uint8_t *p, std::uint32_t v) {
+    p[0] = (std::uint8_t) v;
+    p[1] = (std::uint8_t) (v >> 8);
+    p[2] = (std::uint8_t) (v >> 16);
+    p[3] = (std::uint8_t) (v >> 24);
+}
+
+inline std::uint32_t get_be32(const std::uint8_t *p) {
+    return ((std::uint32_t) p[0] << 24) | ((std::uint32_t) p[1] << 16) | ((std::uint32_t) p[2] << 8) |
+           (std::uint32_t) p[3];
+}
+
+inline void set_be32(std::uint8_t *p, std::uint32_t v) {
+    p[0] = (std::uint8_t) (v >> 24);
+    p[1] = (std::uint8_t) (v >> 16);
+    p[2] = (std::uint8_t) (v >> 8);
+    p[3] = (std::uint8_t) v;
+}
+
+constexpr bool test86_ms_byte(std::uint32_t b) {
+    return ((b + 1) & 0xFE) == 0;
+}
+
+/*
+ * Kernels convert data in place and return the number of processed bytes,
+ * like the *_Convert functions of Bra.h.
+ */
+template <Arch A, Direction D>
+struct Kernel;
+
+template <Direction D>
+struct Kernel<Arch::x86, D> {
+    static std::size_t convert(std::uint8_t *data, std::size_t size, std::uint32_t ip, std::uint32_t &state) {
+        std::size_t pos = 0;
+        std::uint32_t mask = state & 7;
+        if (size < 5) {
+            return 0;
+        }
+        size -= 4;
+        ip += 5;
+        for (;;) {
+            std::uint8_t *p = data + pos;
+            const std::uint8_t *limit = data + size;
+            for (; p < limit; p++) {
+                if ((*p & 0xFE) == 0xE8) {
+                    break;
+                }
+            }
+            std::size_t d = (std::size_t) (p - data) - pos;
+            pos = (std::size_t) (p - data);
+            if (p >= limit) {
+                state = d > 2 ? 0 : mask >> (unsigned) d;
+                return pos;
+            }
+            if (d > 2) {
+                mask = 0;
+            } else {
+                mask >>= (unsigned) d;
+                if (mask != 0 && (mask > 4 || mask == 3 || test86_ms_byte(p[(mask >> 1) + 1]))) {
+                    mask = (mask >> 1) | 4;
+                    pos++;
+                    continue;
+                }
+            }
+            if (test86_ms_byte(p[4])) {
+                std::uint32_t v = get_le32(p + 1);
+                std::uint32_t cur = ip + (std::uint32_t) pos;
+                pos += 5;
+                v = apply<D>(v, cur);
+                if (mask != 0) {
+                    unsigned sh = (mask & 6) << 2;
+                    if (test86_ms_byte((std::uint8_t) (v >> sh))) {
+                        v ^= ((std::uint32_t) 0x100 << sh) - 1;
+                        v = apply<D>(v, cur);
+                    }
+                    mask = 0;
+                }
+                p[1] = (std::uint8_t) v;
+                p[2] = (std::uint8_t) (v >> 8);
+                p[3] = (std::uint8_t) (v >> 16);
+                p[4] = (std::uint8_t) (0 - ((v >> 24) & 1));
+            } else {
+                mask = (mask >> 1) | 4;
+                pos++;
+            }
+        }
+    }
+};
+
+template <Direction D>
+struct Kernel<Arch::arm, D> {
+    static std::size_t convert(std::uint8_t *data, std::size_t size, std::uint32_t ip, std::uint32_t &) {
+        size &= ~(std::size_t) 3;
+        ip += 4;
+        for (std::size_t i = 0; i < size; i += 4) {
+            if (data[i + 3] == 0xEB) {
+                std::uint32_t v = get_le32(data + i) << 2;
+                v = apply<D>(v, ip + (std::uint32_t) (i + 4));
+                set_le32(data + i, ((v >> 2) & 0x00FFFFFF) | 0xEB000000);
+            }
+        }
+        return size;
+    }
+};
+
+template <Direction D>
+struct Kernel<Arch::armt, D> {
+    static std::size_t convert(std::uint8_t *data, std::size_t size, std::uint32_t ip, std::uint32_t &) {
+        size &= ~(std::size_t) 1;
+        if (size < 4) {
+            return 0;
+        }
+        std::size_t i = 0;
+        while (i <= size - 4) {
+            std::uint32_t b1 = data[i + 1] ^ 8u;
+            if ((data[i + 3] & b1) < 0xF8) {
+                i += 2;
+                continue;
+            }
+            std::uint32_t v = (b1 << 19) + (((std::uint32_t) data[i + 3] & 0x7) << 8) +
+                              ((std::uint32_t) data[i] << 11) + data[i + 2];
+            i += 4;
+            v = apply<D>(v, (ip + (std::uint32_t) i) >> 1);
+            data[i - 4] = (std::uint8_t) (v >> 11);
+            data[i - 3] = (std::uint8_t) (0xF0 | ((v >> 19) & 0x7));
+            data[i - 2] = (std::uint8_t) v;
+            data[i - 1] = (std::uint8_t) (0xF8 | (v >> 8));
+        }
+        return i;
+    }
+};
+
+template <Direction D>
+struct Kernel<Arch::ppc, D> {
+    static std::size_t convert(std::uint8_t *data, std::size_t size, std::uint32_t ip, std::uint32_t &) {
+        size &= ~(std::size_t) 3;
+        ip -= 4;
+        for (std::size_t i = 0; i < size; i += 4) {
+            if ((data[i] & 0xFC) == 0x48 && (data[i + 3] & 3) == 1) {
+                std::uint32_t v = apply<D>(get_be32(data + i), ip + (std::uint32_t) (i + 4));
+                set_be32(data + i, (v & 0x03FFFFFF) | 0x48000000);
+            }
+        }
+        return size;
+    }
+};
+
+template <Direction D>
+struct Kernel<Arch::sparc, D> {
+    static std::size_t convert(std::uint8_t *data, std::size_t size, std::uint32_t ip, std::uint32_t &) {
+        size &= ~(std::size_t) 3;
+        ip -= 4;
+        for (std::size_t i = 0; i < size; i += 4) {
+            if ((data[i] == 0x40 && (data[i + 1] & 0xC0) == 0) || (data[i] == 0x7F && data[i + 1] >= 0xC0)) {
+                std::uint32_t v = apply<D>(get_be32(data + i) << 2, ip + (std::uint32_t) (i + 4));
+                v &= 0x01FFFFFF;
+                v -= (std::uint32_t) 1 << 24;
+                v ^= 0xFF000000;
+                set_be32(data + i, (v >> 2) | 0x40000000);
+            }
+        }
+        return size;
+    }
+};
+
+template <Direction D>
+struct Kernel<Arch::ia64, D> {
+    static std::size_t convert(std::uint8_t *data, std::size_t size, std::uint32_t ip, std::uint32_t &) {
+        if (size < 16) {
+            return 0;
+        }
+        std::size_t i = 0;
+        for (; i <= size - 16; i += 16) {
+            unsigned m = ((std::uint32_t) 0x334B0000 >> (data[i] & 0x1E)) & 3;
+            if (m == 0) {
+                continue;
+            }
+            for (m++; m <= 4; m++) {
+                std::uint8_t *p = data + i + m * 5 - 8;
+                if (((p[3] >> m) & 15) != 5 || (((p[-1] | ((std::uint32_t) p[0] << 8)) >> m) & 0x70) != 0) {
+                    continue;
+                }
+                std::uint32_t raw = get_le32(p);
+                std::uint32_t v = raw >> m;
+                v = (v & 0xFFFFF) | ((v & (1 << 23)) >> 3);
+                v = apply<D>(v << 4, ip + (std::uint32_t) i) >> 4;
+                v &= 0x1FFFFF;
+                v += 0x700000;
+                v &= 0x8FFFFF;
+                raw &= ~((std::uint32_t) 0x8FFFFF << m);
+                raw |= v << m;
+                set_le32(p, raw);
+            }
+        }
+        return i;
+    }
+};
+
+/* BL and ADRP, compatible with the ARM64 filter of xz 5.4 and later */
+template <Direction D>
+struct Kernel<Arch::arm64, D> {
+    static std::size_t convert(std::uint8_t *data, std::size_t size, std::uint32_t ip, std::uint32_t &) {
+        size &= ~(std::size_t) 3;
+        for (std::size_t i = 0; i < size; i += 4) {
+            std::uint32_t v = get_le32(data + i);
+            std::uint32_t pc = ip + (std::uint32_t) i;
+            if ((v >> 26) == 0x25) {
+                set_le32(data + i, 0x94000000 | (apply<D>(v, pc >> 2) & 0x03FFFFFF));
+            } else if ((v & 0x9F000000) == 0x90000000) {
+                std::uint32_t src = ((v >> 29) & 3) | ((v >> 3) & 0x001FFFFC);
+                if (((src + 0x00020000) & 0x001C0000) != 0) {
+                    continue;
+                }
+                std::uint32_t dest = apply<D>(src, pc >> 12);
+                v &= 0x9000001F;
+                v |= (dest & 3) << 29;
+                v |= (dest & 0x0003FFFC) << 3;
+                v |= (0 - (dest & 0x00020000)) & 0x00E00000;
+                set_le32(data + i, v);
+            }
+        }
+        return size;
+    }
+};
+
+}  // namespace detail
+
+/*
+ * Streaming filter, the counterpart of the encoder and decoder objects of the
+ * Python module and of BCJContext of bcj.h. The last bytes of each input that
+ * may start a branch are kept and converted together with the next input.
+ */
+template <Arch A, Direction D>
+class Filter {
+public:
+    static constexpr Arch arch = A;
+    static constexpr Direction direction = D;
+
+    /* Size of out that update() needs for size bytes of input. */
+    static constexpr std::size_t bound(std::size_t size) {
+        return size + carry_max;
+    }
+
+    /* Convert a whole stream in place, the same as update() and finish() over the data. */
+    static void convert(std::uint8_t *data, std::size_t size, std::uint32_t start_offset = 0) {
+        std::uint32_t state = 0;
+        detail::Kernel<A, D>::convert(data, size, start_offset, state);
+    }
+
+    explicit Filter(std::uint32_t start_offset = 0, std::uint32_t state = 0) {
+        reset(start_offset, state);
+    }
+
+    /* Start a new stream; carry data is dropped. state is only used by x86. */
+    void reset(std::uint32_t start_offset = 0, std::uint32_t state = 0) {
+        ip_ = start_offset;
+        state_ = A == Arch::x86 ? state & 7 : 0;
+        position_ = 0;
+        carry_size_ = 0;
+    }
+
+    /*
+     * Convert in into out and return the number of bytes written to out.
+     * out should have room for bound(size) bytes and must not overlap in;
+     * bytes past the returned size may be overwritten.
+     */
+    std::size_t update(const std::uint8_t *in, std::size_t size, std::uint8_t *out) {
+        std::size_t out_len = 0;
+
+        position_ += size;
+        if (carry_size_ > 0) {
+            // join carry and head of the input, then convert across the boundary
+            std::size_t carry_size = carry_size_;
+            std::size_t head_size = size < stitch_size ? size : stitch_size;
+            std::memcpy(carry_ + carry_size, in, head_size);
+            carry_size_ += head_size;
+            out_len = run(carry_, carry_size_);
+            std::memcpy(out, carry_, out_len);
+            if (out_len < carry_size) {
+                // too short to go over the carry; the rest is kept
+                carry_size_ -= out_len;
+                std::memmove(carry_, carry_ + out_len, carry_size_);
+                return out_len;
+            }
+            in += out_len - carry_size;
+            size -= out_len - carry_size;
+            carry_size_ = 0;
+        }
+        if (size > 0) {
+            std::memcpy(out + out_len, in, size);
+        }
+        std::size_t len = run(out + out_len, size);
+        // keep the tail as carry data
+        carry_size_ = size - len;
+        std::memcpy(carry_, in + len, carry_size_);
+        return out_len + len;
+    }
+
+    /*
+     * End the stream: convert the carry data and pass through what cannot be
+     * converted. out should have room for carry_max bytes. Returns the number of
+     * bytes written. The filter should be reset to be used again.
+     */
+    std::size_t finish(std::uint8_t *out) {
+        std::size_t size = carry_size_;
+        run(carry_, size);
+        std::memcpy(out, carry_, size);
+        carry_size_ = 0;
+        return size;
+    }
+
+    /* Convert and append the result to out. */
+    void update(const std::uint8_t *in, std::size_t size, std::vector<std::uint8_t> &out) {
+        std::size_t pos = out.size();
+        out.resize(pos + bound(size));
+        out.resize(pos + update(in, size, out.data() + pos));
+    }
+
+    void finish(std::vector<std::uint8_t> &out) {
+        std::size_t pos = out.size();
+        out.resize(pos + carry_max);
+        out.resize(pos + finish(out.data() + pos));
+    }
+
+#ifdef BCJ_HAS_SPAN
+    static void convert(std::span<std::uint8_t> data, std::uint32_t start_offset = 0) {
+        convert(data.data(), data.size(), start_offset);
+    }
+
+    std::size_t update(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+        return update(in.data(), in.size(), out.data());
+    }
+
+    void update(std::span<const std::uint8_t> in, std::vector<std::uint8_t> &out) {
+        update(in.data(), in.size(), out);
+    }
+
+    std::size_t finish(std::span<std::uint8_t> out) {
+        return finish(out.data());
+    }
+#endif
+
+    /* Number of bytes given to update() since the start of the stream. */
+    std::uint64_t position() const {
+        return position_;
+    }
+
+private:
+    /* Bytes of new data joined with the carry bytes, larger than any converter window. */
+    static constexpr std::size_t stitch_size = 32;
+
+    std::size_t run(std::uint8_t *data, std::size_t size) {
+        std::size_t len = detail::Kernel<A, D>::convert(data, size, ip_, state_);
+        ip_ += (std::uint32_t) len;
+        return len;
+    }
+
+    std::uint32_t ip_;
+    std::uint32_t state_;
+    std::uint64_t position_;
+    std::uint8_t carry_[carry_max + stitch_size];
+    std::size_t carry_size_;
+};
+
+template <Direction D>
+using X86 = Filter<Arch::x86, D>;
+template <Direction D>
+using ARM = Filter<Arch::arm, D>;
+template <Direction D>
+using ARMT = Filter<Arch::armt, D>;
+template <Direction D>
+using PPC = Filter<Arch::ppc, D>;
+template <Direction D>
+using SPARC = Filter<Arch::sparc, D>;
+template <Direction D>
+using IA64 = Filter<Arch::ia64, D>;
+template <Direction D>
+using ARM64 = Filter<Arch::arm64, D>;
+
+/*
+ * RAII writer: filters everything written to it and passes the result to sink,
+ * a callable taking (const std::uint8_t *, std::size_t). The end of the stream is
+ * written by close(), or by the destructor when close() was not called; errors
+ * thrown by sink from the destructor are dropped, so call close() to see them.
+ */
+template <Arch A, Direction D, class Sink>
+class Writer {
+public:
+    explicit Writer(Sink sink, std::uint32_t start_offset = 0, std::uint32_t state = 0,
+                    std::size_t buffer_size = 64 * 1024)
+        : sink_(std::move(sink)), filter_(start_offset, state), chunk_(buffer_size > 0 ? buffer_size : 1),
+          buffer_(Filter<A, D>::bound(chunk_)) {}
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    ~Writer() {
+        if (!closed_) {
+            try {
+                close();
+            } catch (...) {
+            }
+        }
+    }
+
+    void write(const std::uint8_t *data, std::size_t size) {
+        while (size > 0) {
+            std::size_t len = size < chunk_ ? size : chunk_;
+            std::size_t out_len = filter_.update(data, len, buffer_.data());
+            if (out_len > 0) {
+                sink_(buffer_.data(), out_len);
+            }
+            data += len;
+            size -= len;
+        }
+    }
+
+#ifdef BCJ_HAS_SPAN
+    void write(std::span<const std::uint8_t> data) {
+        write(data.data(), data.size());
+    }
+#endif
+
+    void close() {
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        std::size_t out_len = filter_.finish(buffer_.data());
+        if (out_len > 0) {
+            sink_(buffer_.data(), out_len);
+        }
+    }
+
+    std::uint64_t position() const {
+        return filter_.position();
+    }
+
+private:
+    Sink sink_;
+    Filter<A, D> filter_;
+    std::size_t chunk_;
+    std::vector<std::uint8_t> buffer_;
+    bool closed_ = false;
+};
+
+}  // namespace bcj
+
+#endif
@@ -0,0 +1,81 @@
+# Test of the bcj command, run by ctest as
+#
+#   cmake -DBCJ=<bcj executable> -DVECTORS=<tests/data/vectors> -DWORK=<scratch directory> -P test_bcj_cli.cmake
+#
+# Each architecture is filtered in both directions with --threads=1 and 2 from and to files, and
+# through pipes: a chain like "bcj -e | bcj -d | bcj -e" writes the encoded vector only when every
+# command gives the right output with standard output and input as pipes.
+
+file(MAKE_DIRECTORY ${WORK})
+set(input ${VECTORS}/input.bin)
+
+function(check_file actual expected what)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${actual} ${expected} RESULT_VARIABLE differ)
+  if(differ)
+    message(SEND_ERROR "${what}: output differs from ${expected}")
+  endif()
+endfunction()
+
+function(check_results results what)
+  foreach(result IN LISTS results)
+    if(NOT result EQUAL 0)
+      message(SEND_ERROR "${what}: exit status ${results}")
+      break()
+    endif()
+  endforeach()
+endfunction()
+
+foreach(arch x86 arm armt ppc sparc ia64 arm64)
+  foreach(threads 1 2)
+    set(name "${arch} --threads=${threads}")
+    set(out ${WORK}/${arch}_${threads}.bin)
+    foreach(direction encode decode)
+      execute_process(
+        COMMAND ${BCJ} --arch=${arch} --${direction} --threads=${threads} --block-size=4K
+        INPUT_FILE ${input}
+        OUTPUT_FILE ${out}
+        RESULT_VARIABLE result)
+      check_results("${result}" "${name} --${direction}")
+      check_file(${out} ${VECTORS}/${arch}_${direction}d.bin "${name} --${direction}")
+    endforeach()
+    execute_process(
+      COMMAND ${BCJ} --arch=${arch} --encode --threads=${threads}
+      COMMAND ${BCJ} --arch=${arch} --decode --threads=${threads} --block-size=4K
+      COMMAND ${BCJ} --arch=${arch} --encode --threads=${threads}
+      INPUT_FILE ${input}
+      OUTPUT_FILE ${out}
+      RESULTS_VARIABLE results)
+    check_results("${results}" "${name} encode | decode | encode")
+    check_file(${out} ${VECTORS}/${arch}_encoded.bin "${name} encode | decode | encode")
+    # the reader is bcj itself, which copies the data out with read(2)
+    execute_process(
+      COMMAND ${BCJ} --arch=${arch} --decode --threads=${threads} --block-size=4K --splice
+      COMMAND ${BCJ} --arch=${arch} --encode --threads=${threads} --splice
+      COMMAND ${BCJ} --arch=${arch} --decode --threads=${threads}
+      INPUT_FILE ${input}
+      OUTPUT_FILE ${out}
+      RESULTS_VARIABLE results)
+    check_results("${results}" "${name} --splice decode | encode | decode")
+    check_file(${out} ${VECTORS}/${arch}_decoded.bin "${name} --splice decode | encode | decode")
+  endforeach()
+endforeach()
+
+# invalid options exit with status 2 before reading anything
+foreach(args "--arch=mips" "--arch" "--arch=arm;--start-offset=2" "--start-offset=8;--arch=ia64"
+             "--start-offset=0x100000000" "--start-offset=-4" "--block-size=1K" "--block-size=2G"
+             "--block-size=4X" "--threads=0" "--frobnicate")
+  execute_process(
+    COMMAND ${BCJ} ${args}
+    INPUT_FILE ${input}
+    OUTPUT_QUIET ERROR_VARIABLE error
+    RESULT_VARIABLE result)
+  if(NOT result EQUAL 2)
+    message(SEND_ERROR "bcj ${args}: exit status ${result}, expected 2")
+  elseif(NOT error MATCHES "^bcj: ")
+    message(SEND_ERROR "bcj ${args}: no error message")
+  endif()
+endforeach()
+execute_process(COMMAND ${BCJ} --version OUTPUT_VARIABLE version RESULT_VARIABLE result)
+if(NOT result EQUAL 0 OR NOT version MATCHES "^bcj [0-9]+\\.[0-9]+\\.[0-9]+")
+  message(SEND_ERROR "bcj --version: exit status ${result}, output '${version}'")
+endif()
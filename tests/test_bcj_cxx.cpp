@@ -0,0 +1,223 @@
+/**
+ * Test of the C++ interface bcj.hpp against the expected files in tests/data/vectors and libbcj.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Built by CMake as test_bcj_cxx and run by ctest with the directory of the vectors:
+ *
+ *     test_bcj_cxx tests/data/vectors
+ *
+ * Every bcj::Filter<Arch, Direction> and bcj::Writer is instantiated. Filters and writers are given
+ * input.bin in random chunks and checked against <arch>_encoded.bin and <arch>_decoded.bin, as
+ * test_libbcj.c does for bcj.h; then against BCJContext of libbcj from other start offsets and
+ * x86 states, since the kernels of bcj.hpp are a separate copy of the C converters.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bcj.h"
+#include "bcj.hpp"
+
+namespace {
+
+using Bytes = std::vector<std::uint8_t>;
+
+const char *const arch_names[] = {"x86", "arm", "armt", "ppc", "sparc", "ia64", "arm64"};
+
+/* Chunked runs of each filter, with different seeds. */
+constexpr std::uint32_t rounds = 50;
+
+int failures = 0;
+
+void check(bool cond, const std::string &what) {
+    if (!cond) {
+        std::fprintf(stderr, "%s\n", what.c_str());
+        failures++;
+    }
+}
+
+bool read_file(const std::string &path, Bytes &data) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        std::fprintf(stderr, "%s: cannot read\n", path.c_str());
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/* xorshift32, the same chunks as test_libbcj.c */
+std::uint32_t next_random(std::uint32_t &seed) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+std::size_t next_chunk(std::uint32_t &seed) {
+    std::uint32_t r = next_random(seed);
+    switch (r % 8) {
+        case 0:
+            return 0;
+        case 1:
+        case 2:
+        case 3:
+            return (r >> 8) % 24;
+        case 4:
+        case 5:
+            return (r >> 8) % 300;
+        default:
+            return (r >> 8) % 5000;
+    }
+}
+
+template <bcj::Arch A, bcj::Direction D>
+std::string name() {
+    return std::string(arch_names[static_cast<int>(A)]) + (D == bcj::Direction::encode ? " encode" : " decode");
+}
+
+/* Filter input in random chunks through both update() overloads, as one stream. */
+template <bcj::Arch A, bcj::Direction D>
+Bytes filter_chunked(const Bytes &input, std::uint32_t seed, std::uint32_t start_offset, std::uint32_t state) {
+    bcj::Filter<A, D> filter(start_offset, state);
+    Bytes out;
+    std::size_t pos = 0;
+    while (pos < input.size()) {
+        std::size_t len = next_chunk(seed);
+        if (len > input.size() - pos) {
+            len = input.size() - pos;
+        }
+        if (seed & 1) {
+            filter.update(input.data() + pos, len, out);
+        } else {
+            std::size_t old = out.size();
+            out.resize(old + bcj::Filter<A, D>::bound(len));
+            out.resize(old + filter.update(input.data() + pos, len, out.data() + old));
+        }
+        pos += len;
+        check(filter.position() == pos, name<A, D>() + ": wrong position");
+        check(pos - out.size() <= bcj::carry_max, name<A, D>() + ": too many carry bytes");
+    }
+    filter.finish(out);
+    return out;
+}
+
+/* Write input in random chunks to a Writer with a small buffer; close() or the destructor ends it. */
+template <bcj::Arch A, bcj::Direction D>
+Bytes write_chunked(const Bytes &input, std::uint32_t seed, bool close) {
+    Bytes out;
+    {
+        auto sink = [&out](const std::uint8_t *data, std::size_t size) { out.insert(out.end(), data, data + size); };
+        bcj::Writer<A, D, decltype(sink)> writer(sink, 0, 0, 1 + seed % 4096);
+        std::size_t pos = 0;
+        while (pos < input.size()) {
+            std::size_t len = next_chunk(seed);
+            if (len > input.size() - pos) {
+                len = input.size() - pos;
+            }
+            writer.write(input.data() + pos, len);
+            pos += len;
+        }
+        check(writer.position() == input.size(), name<A, D>() + ": wrong writer position");
+        if (close) {
+            writer.close();
+            writer.close();
+        }
+    }
+    return out;
+}
+
+/* The same stream through BCJContext of libbcj, in one update. */
+Bytes filter_libbcj(int arch, int encoding, const Bytes &input, std::uint32_t start_offset, std::uint32_t state) {
+    BCJContext *ctx = nullptr;
+    Bytes out(BCJ_UPDATE_BOUND(input.size()));
+    if (BCJ_ContextCreate(&ctx, arch, encoding, start_offset, state) != 0) {
+        return Bytes();
+    }
+    std::size_t len = BCJ_ContextUpdate(ctx, input.data(), input.size(), out.data());
+    len += BCJ_ContextFinish(ctx, out.data() + len);
+    BCJ_ContextDestroy(ctx);
+    out.resize(len);
+    return out;
+}
+
+template <bcj::Arch A, bcj::Direction D>
+void test_filter(const std::string &dir, const Bytes &input) {
+    constexpr bool encode = D == bcj::Direction::encode;
+    const std::string file = std::string(arch_names[static_cast<int>(A)]) + (encode ? "_encoded.bin" : "_decoded.bin");
+    Bytes expected;
+    if (!read_file(dir + "/" + file, expected)) {
+        failures++;
+        return;
+    }
+
+    Bytes data = input;
+    bcj::Filter<A, D>::convert(data.data(), data.size());
+    check(data == expected, file + ": convert() differs");
+    for (std::uint32_t round = 1; round <= rounds; round++) {
+        std::uint32_t seed = 0x9E3779B9u * round;
+        check(filter_chunked<A, D>(input, seed, 0, 0) == expected,
+              file + ": chunked update() differs, seed " + std::to_string(seed));
+        check(write_chunked<A, D>(input, seed, round % 2 == 0) == expected,
+              file + ": Writer differs, seed " + std::to_string(seed));
+    }
+
+    // reset() starts the same stream again
+    bcj::Filter<A, D> filter(0x1000, 0);
+    Bytes first;
+    filter.update(input.data(), input.size(), first);
+    filter.reset();
+    Bytes out;
+    filter.update(input.data(), input.size(), out);
+    filter.finish(out);
+    check(out == expected, file + ": output after reset() differs");
+
+    // other start offsets and states, against libbcj
+    for (std::uint32_t round = 1; round <= 8; round++) {
+        std::uint32_t seed = 0x85EBCA6Bu * round;
+        std::uint32_t start_offset = next_random(seed) & ~(std::uint32_t) 15;
+        std::uint32_t state = A == bcj::Arch::x86 ? round % 8 : 0;
+        check(filter_chunked<A, D>(input, seed, start_offset, state) ==
+                  filter_libbcj(static_cast<int>(A), encode ? BCJ_ENCODE : BCJ_DECODE, input, start_offset, state),
+              file + ": differs from libbcj at start offset " + std::to_string(start_offset));
+    }
+}
+
+template <bcj::Arch A>
+void test_arch(const std::string &dir, const Bytes &input) {
+    test_filter<A, bcj::Direction::decode>(dir, input);
+    test_filter<A, bcj::Direction::encode>(dir, input);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s <vectors directory>\n", argv[0]);
+        return 2;
+    }
+    const std::string dir = argv[1];
+    Bytes input;
+    if (!read_file(dir + "/input.bin", input)) {
+        return 1;
+    }
+    static_assert(static_cast<int>(bcj::Arch::arm64) == BCJ_ARCH_ARM64, "bcj::Arch and BCJArch should match");
+    test_arch<bcj::Arch::x86>(dir, input);
+    test_arch<bcj::Arch::arm>(dir, input);
+    test_arch<bcj::Arch::armt>(dir, input);
+    test_arch<bcj::Arch::ppc>(dir, input);
+    test_arch<bcj::Arch::sparc>(dir, input);
+    test_arch<bcj::Arch::ia64>(dir, input);
+    test_arch<bcj::Arch::arm64>(dir, input);
+    if (failures > 0) {
+        std::fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    std::printf("bcj.hpp: 7 architectures, both directions, %u chunked runs each\n", (unsigned) rounds);
+    return 0;
+}
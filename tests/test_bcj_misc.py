@@ -1,9 +1,16 @@
 import binascii
 import hashlib
+import io
 import pathlib
+import pickle
+import threading
 import zipfile
+import zlib
+
+import pytest
 
 import bcj
+import bcj._bcjfilter
 
 
 def test_aarch64_encode(tmp_path):
@@ -19,6 +26,23 @@ def test_aarch64_encode(tmp_path):
     assert m.digest() == binascii.unhexlify("be4b1217015838b417a255a3bb1d17ec8a9357c0e195b00bcd5b48959aac8295")
 
 
+@pytest.mark.parametrize("start_offset, expected", [
+    (0, "6cc09d913d5e3213ca1710daadf2b0875c379971d869b04150281fdd2b77477d"),
+    (4096, "73a5f9e91a82be83bf23e7762420cbf1a9685efc992051919981459cc0771769"),
+])
+def test_arm64_encode(start_offset, expected):
+    # expected values are of xz --format=raw --arm64=start=N --lzma2, decompressed without --arm64
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/lib.zip")) as f:
+        src = f.read("lib/aarch64-linux-gnu/liblzma.so.0")
+    encoder = bcj.ARM64Encoder(start_offset=start_offset)
+    dest = encoder.encode(src) + encoder.flush()
+    assert hashlib.sha256(dest).hexdigest() == expected
+    py_encoder = bcj._bcjfilter.ARM64Encoder(start_offset=start_offset)
+    assert py_encoder.encode(src) + py_encoder.flush() == dest
+    decoder = bcj.ARM64Decoder(len(dest), start_offset=start_offset)
+    assert decoder.decode(dest) == src
+
+
 def test_ppc_encode(tmp_path):
     with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/lib.zip")) as f:
         src = f.read("lib/powerpc64le-linux-gnu/liblzma.so.0")
@@ -30,3 +54,487 @@ def test_ppc_encode(tmp_path):
     m = hashlib.sha256()
     m.update(dest)
     assert m.digest() == binascii.unhexlify("0289683dfa366682f0d6cc17880ed64b1f98ab889bc62dff0b9098bcdd8d4af3")
+
+
+def test_x86_checksum(tmp_path):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as zipsrc:
+        src = zipsrc.read("x86_1.bin")
+    encoder = bcj.BCJEncoder(checksum="crc32")
+    dest = encoder.encode(src[:5000])
+    dest += encoder.encode(src[5000:])
+    dest += encoder.flush()
+    assert encoder.digest() == zlib.crc32(src)
+    decoder = bcj.BCJDecoder(len(dest), checksum="crc32")
+    result = decoder.decode(dest)
+    assert result == src
+    assert decoder.digest() == zlib.crc32(src)
+
+
+def test_crc64_check_value():
+    encoder = bcj.ARMEncoder(checksum="crc64")
+    encoder.encode(b"123456789")
+    encoder.flush()
+    assert encoder.digest() == 0x995DC9BBDF1939FA
+
+
+def test_checksum_disabled():
+    encoder = bcj.PPCEncoder()
+    with pytest.raises(ValueError):
+        encoder.digest()
+    with pytest.raises(ValueError):
+        bcj.PPCDecoder(10, checksum="md5")
+
+
+@pytest.mark.parametrize("name", ["BCJ", "ARM", "ARMT", "PPC", "Sparc", "IA64", "ARM64"])
+def test_chunked_same_as_once(name):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/lib.zip")) as f:
+        src = f.read("lib/aarch64-linux-gnu/liblzma.so.0")[:100000]
+    encoder = getattr(bcj, name + "Encoder")()
+    expected = encoder.encode(src) + encoder.flush()
+    encoder = getattr(bcj, name + "Encoder")()
+    dest = bytearray()
+    pos = 0
+    for size in [1, 3, 7, 17, 4093, 70001]:
+        dest += encoder.encode(src[pos : pos + size])
+        pos += size
+    dest += encoder.encode(src[pos:])
+    dest += encoder.flush()
+    assert dest == expected
+    decoder = getattr(bcj, name + "Decoder")(len(dest))
+    result = bytearray()
+    pos = 0
+    for size in [5, 2, 70001, 13]:
+        result += decoder.decode(dest[pos : pos + size])
+        pos += size
+    result += decoder.decode(dest[pos:])
+    assert result == src
+
+
+def test_pass_through_no_branch():
+    data = bytes(65536)
+    encoder = bcj.ARMEncoder(checksum="crc32")
+    assert encoder.encode(data) is data
+    assert encoder.digest() == zlib.crc32(data)
+    decoder = bcj.BCJDecoder(len(data))
+    assert decoder.decode(data) is data
+    # the lookahead at the end is passed too when it cannot start a branch
+    assert bcj.BCJEncoder().encode(data) is data
+    assert bcj.ARMTEncoder().encode(data) is data
+    decoder = bcj.BCJDecoder(3 * len(data))
+    assert decoder.decode(data) is data
+    assert decoder.decode(data) is data
+    decoder = bcj.BCJDecoder()
+    assert decoder.decode(data) is data
+    # a candidate in the last bytes is kept back for the next call
+    encoder = bcj.BCJEncoder()
+    assert encoder.encode(data + b"\xe8") == data
+    reference = bcj.BCJEncoder()
+    expected = reference.encode(data + b"\xe8" + bytes(4)) + reference.flush()
+    assert encoder.encode(bytes(4)) + encoder.flush() == expected[len(data) :]
+    # a branch after long padding is still converted
+    src = bytes(70000) + b"\xe8\x10\x00\x00\x00" + bytes(16)
+    encoder = bcj.BCJEncoder()
+    dest = encoder.encode(src) + encoder.flush()
+    assert dest != src
+    decoder = bcj.BCJDecoder(len(dest))
+    assert decoder.decode(dest) == src
+
+
+def test_arm_decode_from_offset():
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/lib.zip")) as f:
+        src = f.read("lib/aarch64-linux-gnu/liblzma.so.0")
+    encoder = bcj.ARMEncoder()
+    dest = encoder.encode(src) + encoder.flush()
+    offset = 40960
+    decoder = bcj.ARMDecoder(len(dest) - offset, start_offset=offset)
+    assert decoder.decode(dest[offset:]) == src[offset:]
+
+
+def test_arm_decode_from_checkpoints():
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/lib.zip")) as f:
+        src = f.read("lib/aarch64-linux-gnu/liblzma.so.0")
+    encoder = bcj.ARMEncoder(start_offset=0x1000, index_interval=32768)
+    dest = encoder.encode(src) + encoder.flush()
+    checkpoints = encoder.checkpoints()
+    assert checkpoints[0] == (0, 0x1000, 0)
+    assert bcj.ARMEncoder().checkpoints() == []
+    offset, ip, _ = checkpoints[len(checkpoints) // 2]
+    assert ip == offset + 0x1000
+    decoder = bcj.ARMDecoder(len(dest) - offset, start_offset=ip)
+    assert decoder.decode(dest[offset:]) == src[offset:]
+
+
+@pytest.mark.parametrize("name", ["BCJ", "ARM", "ARMT", "PPC", "Sparc", "IA64", "ARM64"])
+def test_pickle_resume(name):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_1.bin")
+    encoder = getattr(bcj, name + "Encoder")(checksum="crc32")
+    head = encoder.encode(src[:5001])
+    encoder = pickle.loads(pickle.dumps(encoder))
+    dest = head + encoder.encode(src[5001:]) + encoder.flush()
+    assert encoder.digest() == zlib.crc32(src)
+    reference = getattr(bcj, name + "Encoder")()
+    assert dest == reference.encode(src) + reference.flush()
+    decoder = getattr(bcj, name + "Decoder")(len(dest))
+    head = decoder.decode(dest[:3333])
+    decoder = pickle.loads(pickle.dumps(decoder))
+    assert head + decoder.decode(dest[3333:]) == src
+
+
+class OffsetEncoder(bcj.ARMEncoder):
+    def __init__(self, start_offset, label):
+        super().__init__(start_offset=start_offset)
+        self.label = label
+
+
+def test_pickle_subclass():
+    src = b"\0\0\0\xeb" * 64
+    encoder = OffsetEncoder(0x100, "arm")
+    head = encoder.encode(src[:30])
+    encoder = pickle.loads(pickle.dumps(encoder))
+    assert type(encoder) is OffsetEncoder
+    assert encoder.label == "arm"
+    reference = bcj.ARMEncoder(start_offset=0x100)
+    assert head + encoder.encode(src[30:]) + encoder.flush() == reference.encode(src) + reference.flush()
+
+
+@pytest.mark.skipif(bcj.BCJEncoder.__module__ != "bcj._bcj", reason="state of the C implementation")
+def test_setstate_invalid():
+    encoder = bcj.BCJEncoder(start_offset=0x1000, index_interval=64)
+    encoder.encode(bytes(200))
+    state = encoder.__reduce__()[2]
+    bcj.BCJEncoder().__setstate__(state)
+    arm_state = bcj.ARMEncoder(start_offset=4).__reduce__()[2]
+    bcj.ARMEncoder.__new__(bcj.ARMEncoder).__setstate__(arm_state)
+
+    def invalid(state, i, value, cls=bcj.BCJEncoder):
+        bad = list(state)
+        bad[i] = value
+        for obj in (cls(), cls.__new__(cls)):
+            with pytest.raises(ValueError):
+                obj.__setstate__(tuple(bad))
+
+    invalid(state, 4, 8)  # x86 state
+    invalid(state, 2, 3)  # read ahead of another method
+    invalid(state, 12, state[12] + 64)  # next checkpoint
+    invalid(state, 13, [])  # no checkpoint at the start
+    invalid(state, 13, list(reversed(state[13])))
+    invalid(state, 13, state[13][:1] + [(64, state[3], 0)])  # ip does not follow the offset
+    invalid(state, 13, state[13] + [(state[6] + 64, state[3] + 64, 0)])  # checkpoint past the position
+    invalid(state, 13, state[13][:1] + [(64, 0x1000 + 64, 8)])
+    invalid(arm_state, 3, 6, bcj.ARMEncoder)  # start offset not aligned
+    invalid(arm_state, 4, 1, bcj.ARMEncoder)  # state of a non-x86 filter
+    with pytest.raises(ValueError):
+        bcj.ARMEncoder().__setstate__(state)
+    with pytest.raises(ValueError):
+        bcj.BCJDecoder().__setstate__(state)
+
+
+@pytest.mark.parametrize("name", ["BCJ", "ARM", "PPC"])
+def test_copy_shared_prefix(name):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_1.bin")
+    prefix, tail1, tail2 = src[:6001], src[6001:], bytes(reversed(src[6001:]))
+    encoder = getattr(bcj, name + "Encoder")(checksum="crc64")
+    head = encoder.encode(prefix)
+    branch = encoder.copy()
+    dest1 = head + encoder.encode(tail1) + encoder.flush()
+    dest2 = head + branch.encode(tail2) + branch.flush()
+    for tail, dest, filter in ((tail1, dest1, encoder), (tail2, dest2, branch)):
+        reference = getattr(bcj, name + "Encoder")(checksum="crc64")
+        assert dest == reference.encode(prefix + tail) + reference.flush()
+        assert filter.digest() == reference.digest()
+
+
+@pytest.mark.parametrize("name", ["BCJ", "ARM", "IA64"])
+def test_decode_max_length(name):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_1.bin")[:10010]
+    encoder = getattr(bcj, name + "Encoder")()
+    dest = encoder.encode(src) + encoder.flush()
+    decoder = getattr(bcj, name + "Decoder")(len(dest))
+    assert decoder.needs_input
+    result = decoder.decode(dest, max_length=100)
+    assert len(result) == 100
+    assert not decoder.needs_input
+    assert decoder.decode(b"", 0) == b""
+    while not decoder.needs_input:
+        chunk = decoder.decode(b"", max_length=333)
+        assert 0 < len(chunk) <= 333
+        result += chunk
+    assert result == src
+
+
+def test_decode_byte_by_byte_tail():
+    src = b"\x90" * 3 + b"\xe8\x10\x00\x00\x00"
+    encoder = bcj.BCJEncoder()
+    dest = encoder.encode(src) + encoder.flush()
+    decoder = bcj.BCJDecoder(len(dest))
+    assert b"".join(decoder.decode(dest[i : i + 1]) for i in range(len(dest))) == src
+
+
+@pytest.mark.parametrize("name", ["BCJ", "ARM", "ARMT", "PPC", "Sparc", "IA64"])
+def test_decode_unknown_size(name):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        # end with an x86 call opcode and an ARMT BL prefix, so the decoders keep the tail for flush()
+        src = f.read("x86_1.bin")[:10010] + b"\x00\xe8\x00\xf0"
+    encoder = getattr(bcj, name + "Encoder")()
+    dest = encoder.encode(src) + encoder.flush()
+    decoder = getattr(bcj, name + "Decoder")(checksum="crc32")
+    result = b"".join(decoder.decode(dest[i : i + 1000]) for i in range(0, len(dest), 1000))
+    assert len(result) < len(src)
+    assert result + decoder.flush() == src
+    assert decoder.digest() == zlib.crc32(src)
+
+
+@pytest.mark.parametrize("name", ["BCJ", "ARM", "PPC"])
+def test_reset(name):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_1.bin")
+    encoder = getattr(bcj, name + "Encoder")(checksum="crc32", index_interval=4096)
+    first = encoder.encode(src[:7777])
+    encoder.reset(start_offset=0x100)
+    dest = encoder.encode(src) + encoder.flush()
+    reference = getattr(bcj, name + "Encoder")(checksum="crc32", start_offset=0x100, index_interval=4096)
+    assert dest == reference.encode(src) + reference.flush()
+    assert encoder.digest() == reference.digest()
+    assert encoder.checkpoints() == reference.checkpoints()
+    with pytest.raises(TypeError):
+        encoder.reset(100)
+    decoder = getattr(bcj, name + "Decoder")()
+    decoder.decode(first)
+    decoder.reset(len(dest), start_offset=0x100)
+    assert decoder.decode(dest) == src
+
+
+@pytest.mark.parametrize("name", ["BCJ", "ARM", "ARMT"])
+def test_scatter_gather(name):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_1.bin")
+    pieces = [src[i : i + 1021] for i in range(0, len(src), 1021)]
+    encoder = getattr(bcj, name + "Encoder")()
+    dest = encoder.encode(src) + encoder.flush()
+    encoder = getattr(bcj, name + "Encoder")()
+    assert encoder.encode(pieces) + encoder.flush() == dest
+    encoder = getattr(bcj, name + "Encoder")()
+    views = encoder.encode(tuple(bytearray(piece) for piece in pieces), as_list=True)
+    assert len(views) == len(pieces)
+    assert all(isinstance(view, memoryview) for view in views)
+    assert b"".join(views) + encoder.flush() == dest
+    decoder = getattr(bcj, name + "Decoder")(len(dest))
+    views = decoder.decode([dest[:5000], memoryview(dest)[5000:]], as_list=True)
+    assert b"".join(views) == src
+
+
+def test_encode_decode_to_sink(tmp_path):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_1.bin")
+    encoder = bcj.BCJEncoder()
+    dest = encoder.encode(src) + encoder.flush()
+    encoder = bcj.BCJEncoder()
+    with open(tmp_path.joinpath("output.bin"), "wb", buffering=0) as f:
+        written = encoder.encode_to(f.fileno(), src[:5000])
+        written += encoder.encode_to(f.fileno(), src[5000:], flush=True)
+    assert written == len(dest)
+    assert tmp_path.joinpath("output.bin").read_bytes() == dest
+    decoder = bcj.BCJDecoder()
+    sink = io.BytesIO()
+    assert decoder.decode_to(sink, [dest[:3000], dest[3000:]], flush=True) == len(src)
+    assert sink.getvalue() == src
+    with pytest.raises(TypeError):
+        decoder.decode_to(object(), b"")
+
+
+def test_reentrant_sink(tmp_path):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_1.bin")
+
+    class Sink:
+        def __init__(self, encoder):
+            self.encoder = encoder
+            self.parts = []
+
+        def write(self, data):
+            self.parts.append(bytes(data))
+            if len(self.parts) == 1:
+                # the filter is not locked while its output is written
+                self.parts.append(self.encoder.encode(src[6000:]))
+            return len(data)
+
+    encoder = bcj.BCJEncoder()
+    sink = Sink(encoder)
+    encoder.encode_to(sink, src[:6000])
+    reference = bcj.BCJEncoder()
+    expected = reference.encode(src) + reference.flush()
+    assert b"".join(sink.parts) + encoder.flush() == expected
+    # a raw file is written through its descriptor
+    encoder = bcj.BCJEncoder()
+    with open(tmp_path.joinpath("output.bin"), "wb", buffering=0) as f:
+        assert encoder.encode_to(f, src, flush=True) == len(expected)
+    assert tmp_path.joinpath("output.bin").read_bytes() == expected
+    with open(tmp_path.joinpath("output.bin"), "rb", buffering=0) as f:
+        with pytest.raises(io.UnsupportedOperation):
+            bcj.BCJEncoder().encode_to(f, src, flush=True)
+
+
+@pytest.mark.parametrize("arch, encoder, encode", [("x86", bcj.BCJEncoder, True), ("x86", bcj.BCJDecoder, False),
+                                                   ("arm", bcj.ARMEncoder, True), ("sparc", bcj.SparcDecoder, False)])
+def test_pipe(tmp_path, arch, encoder, encode):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_3.bin")
+    filter = encoder(start_offset=100)
+    expected = (filter.encode(src) if encode else filter.decode(src)) + filter.flush()
+    tmp_path.joinpath("input.bin").write_bytes(src)
+    with open(tmp_path.joinpath("input.bin"), "rb") as fin, open(tmp_path.joinpath("output.bin"), "wb") as fout:
+        written = bcj.pipe(fin.fileno(), fout.fileno(), arch, encode=encode, start_offset=100, block_size=100000, blocks=3)
+    assert written == len(expected)
+    assert tmp_path.joinpath("output.bin").read_bytes() == expected
+
+
+@pytest.mark.parametrize("module", [bcj, bcj._bcjfilter])
+@pytest.mark.parametrize("name, alignment", [("BCJ", 1), ("ARM", 4), ("ARMT", 2), ("PPC", 4), ("Sparc", 4),
+                                             ("IA64", 16), ("ARM64", 4)])
+def test_start_offset_checked(module, name, alignment):
+    if not hasattr(module, name + "Encoder"):
+        pytest.skip("no {} filter in {}".format(name, module.__name__))
+    encoder = getattr(module, name + "Encoder")
+    decoder = getattr(module, name + "Decoder")
+    assert encoder(start_offset=0xFFFFFFFF - 0xFFFFFFFF % alignment).checkpoints() == []
+    with pytest.raises(ValueError):
+        encoder(start_offset=1 << 32)
+    with pytest.raises(ValueError):
+        decoder(start_offset=(1 << 64) + alignment)
+    with pytest.raises(ValueError):
+        decoder(start_offset=-alignment)
+    if alignment > 1:
+        with pytest.raises(ValueError):
+            encoder(start_offset=alignment // 2)
+        with pytest.raises(ValueError):
+            decoder(start_offset=alignment + 1)
+        with pytest.raises(ValueError):
+            encoder().reset(start_offset=alignment // 2)
+
+
+@pytest.mark.parametrize("module", [bcj, bcj._bcjfilter])
+@pytest.mark.parametrize("state", [8, -1, (1 << 32) + 1, (1 << 64) + 1])
+def test_state_checked(module, state):
+    with pytest.raises(ValueError):
+        module.BCJDecoder(10, state=state)
+    with pytest.raises(ValueError):
+        module.BCJEncoder(state=state)
+    with pytest.raises(ValueError):
+        module.BCJEncoder().reset(state=state)
+    assert module.BCJDecoder(10, state=7).decode(bytes(10)) == bytes(10)
+
+
+def test_pipe_start_offset_checked(tmp_path):
+    tmp_path.joinpath("input.bin").write_bytes(bytes(100))
+    with open(tmp_path.joinpath("input.bin"), "rb") as fin, open(tmp_path.joinpath("output.bin"), "wb") as fout:
+        with pytest.raises(ValueError):
+            bcj.pipe(fin.fileno(), fout.fileno(), "arm", start_offset=2)
+        with pytest.raises(ValueError):
+            bcj.pipe(fin.fileno(), fout.fileno(), "x86", start_offset=1 << 32)
+        with pytest.raises(ValueError):
+            bcj.pipe(fin.fileno(), fout.fileno(), "x86", start_offset=1 << 64)
+        with pytest.raises(ValueError):
+            bcj.pipe(fin.fileno(), fout.fileno(), "x86", state=(1 << 32) + 1)
+    with pytest.raises(ValueError):
+        bcj.filter_file(tmp_path.joinpath("input.bin"), tmp_path.joinpath("output.bin"), "ia64", start_offset=8)
+    with pytest.raises(ValueError):
+        bcj.filter_file(tmp_path.joinpath("input.bin"), tmp_path.joinpath("output.bin"), "x86", state=(1 << 64) + 1)
+
+
+@pytest.mark.parametrize("engine, direct", [("auto", False), ("auto", True), ("pread", False)])
+def test_filter_file(tmp_path, engine, direct):
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as f:
+        src = f.read("x86_3.bin")
+    encoder = bcj.BCJEncoder()
+    expected = encoder.encode(src) + encoder.flush()
+    tmp_path.joinpath("input.bin").write_bytes(src)
+    written = bcj.filter_file(tmp_path.joinpath("input.bin"), tmp_path.joinpath("output.bin"), "x86",
+                              block_size=65536, queue_depth=4, direct=direct, engine=engine)
+    assert written == len(expected)
+    assert tmp_path.joinpath("output.bin").read_bytes() == expected
+
+
+def test_threads():
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/lib.zip")) as f:
+        src = f.read("lib/aarch64-linux-gnu/liblzma.so.0")[:200000]
+    encoder = bcj.ARMEncoder()
+    expected = encoder.encode(src) + encoder.flush()
+    shared = bcj.ARMEncoder()
+    results = [None] * 8
+    shared_sizes = [0] * 8
+
+    def work(i):
+        encoder = bcj.ARMEncoder()
+        results[i] = encoder.encode(src) + encoder.flush()
+        for pos in range(0, len(src), 4096):
+            shared_sizes[i] += len(shared.encode(src[pos : pos + 4096]))
+
+    threads = [threading.Thread(target=work, args=(i,)) for i in range(8)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    assert results == [expected] * 8
+    # calls on one object are serialized, so no byte is lost or duplicated
+    assert sum(shared_sizes) + len(shared.flush()) == len(src) * 8
+
+
+def test_subinterpreters(tmp_path):
+    try:
+        import _interpreters as interpreters
+    except ImportError:
+        interpreters = pytest.importorskip("_xxsubinterpreters")
+    if not hasattr(bcj, "_bcj"):
+        pytest.skip("C extension is not used")
+    result = tmp_path.joinpath("result.bin")
+    script = f"""if True:
+        import bcj
+        encoder = bcj.ARMEncoder()
+        data = encoder.encode(bytes(range(256)) * 64) + encoder.flush()
+        decoder = bcj.ARMDecoder(len(data))
+        assert decoder.decode(data) == bytes(range(256)) * 64
+        open({str(result)!r}, "wb").write(data)
+    """
+    encoder = bcj.ARMEncoder()
+    expected = encoder.encode(bytes(range(256)) * 64) + encoder.flush()
+    for _ in range(2):
+        interp = interpreters.create()
+        try:
+            interpreters.run_string(interp, script)
+        finally:
+            interpreters.destroy(interp)
+        assert result.read_bytes() == expected
+        result.unlink()
+
+
+def test_arguments():
+    encoder = bcj.BCJEncoder("crc32", start_offset=16, state=0)
+    assert isinstance(encoder.encode(data=b"\xe8\0\0\0\0", as_list=False), bytes)
+    decoder = bcj.ARMDecoder(None, None, start_offset=4)
+    assert decoder.decode(b"abcd", -1) == b"abcd"
+    with pytest.raises(TypeError):
+        bcj.ARMEncoder(None, 0)
+    with pytest.raises(TypeError):
+        bcj.ARMEncoder(state=0)
+    with pytest.raises(TypeError):
+        bcj.ARMDecoder(1, size=1)
+    with pytest.raises(TypeError):
+        encoder.encode()
+    with pytest.raises(TypeError):
+        encoder.encode(b"", True)
+    with pytest.raises(TypeError):
+        encoder.flush(True)
+    with pytest.raises(TypeError):
+        bcj.BCJEncoder(start_offset="0")
+
+    class Encoder(bcj.ARMEncoder):
+        def __init__(self, start_offset):
+            super().__init__(start_offset=start_offset)
+
+    encoder = Encoder(8)
+    expected = bcj.ARMEncoder(start_offset=8)
+    data = b"\0\0\0\xeb" * 4
+    assert encoder.encode(data) + encoder.flush() == expected.encode(data) + expected.flush()
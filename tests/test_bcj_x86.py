@@ -3,6 +3,8 @@ import hashlib
 import pathlib
 import zipfile
 
+import pytest
+
 import bcj
 
 BLOCKSIZE = 8192
@@ -205,3 +207,33 @@ def test_x86_encode_decode_large(tmp_path):
         m.update(dest)
         hashresult = m.digest()
     assert hashresult == hashsrc
+
+
+def test_x86_decode_from_offset():
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as zipsrc:
+        code = zipsrc.read("x86_1.bin")
+    src = code + bytes(16) + code
+    encoder = bcj.BCJEncoder()
+    dest = encoder.encode(src) + encoder.flush()
+    # no branch just before the offset, so x86 state is zero there
+    offset = len(code) + 8
+    decoder = bcj.BCJDecoder(len(dest) - offset, start_offset=offset, state=0)
+    assert decoder.decode(dest[offset:]) == src[offset:]
+    with pytest.raises(ValueError):
+        bcj.BCJDecoder(10, state=8)
+
+
+def test_x86_decode_from_checkpoints():
+    with zipfile.ZipFile(pathlib.Path(__file__).parent.joinpath("data/src.zip")) as zipsrc:
+        src = zipsrc.read("x86_3.bin")[:200000]
+    encoder = bcj.BCJEncoder(index_interval=16384)
+    dest = b""
+    for i in range(0, len(src), BLOCKSIZE):
+        dest += encoder.encode(src[i : i + BLOCKSIZE])
+    dest += encoder.flush()
+    checkpoints = encoder.checkpoints()
+    assert checkpoints[0] == (0, 0, 0)
+    assert len(checkpoints) >= len(src) // 16384
+    for offset, ip, state in checkpoints:
+        decoder = bcj.BCJDecoder(len(dest) - offset, start_offset=ip, state=state)
+        assert decoder.decode(dest[offset:]) == src[offset:]
@@ -0,0 +1,196 @@
+/**
+ * Test of libbcj against the expected files in tests/data/vectors.
+ * Copyright 2020-2022, Hiroshi Miura
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Built by CMake as test_libbcj_static and test_libbcj_shared and run by ctest with the
+ * directory of the vectors:
+ *
+ *     test_libbcj_static tests/data/vectors
+ *
+ * <arch>_encoded.bin and <arch>_decoded.bin are input.bin encoded and decoded as a whole stream
+ * from offset 0 by the encoders and decoders of the Python module, with flush().
+ * Each is checked with BCJ_Encode/BCJ_Decode, and with a context given input.bin in random chunks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bcj.h"
+
+static const char *const archNames[] = {"x86", "arm", "armt", "ppc", "sparc", "ia64", "arm64"};
+
+#define TEST_ARCHS (sizeof(archNames) / sizeof(archNames[0]))
+
+/* Chunked runs of each file, with different seeds. */
+#define TEST_ROUNDS 50
+
+static int failures = 0;
+
+#define TEST_CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            failures++; \
+        } \
+    } while (0)
+
+/* Read a whole file, NULL on error. */
+static uint8_t *
+test_read(const char *dir, const char *name, size_t *size) {
+    char path[4096];
+    FILE *f;
+    uint8_t *data = NULL;
+    long len;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        data = malloc(len > 0 ? (size_t) len : 1);
+        if (data != NULL && fread(data, 1, (size_t) len, f) != (size_t) len) {
+            free(data);
+            data = NULL;
+        }
+        *size = (size_t) len;
+    }
+    if (data == NULL) {
+        fprintf(stderr, "%s: cannot read\n", path);
+    }
+    fclose(f);
+    return data;
+}
+
+/* xorshift32, so the chunks are the same on every platform */
+static uint32_t
+test_random(uint32_t *seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+/* Size of the next chunk: mostly short ones around the carry sizes, some empty and some long. */
+static size_t
+test_chunk(uint32_t *seed) {
+    uint32_t r = test_random(seed);
+    switch (r % 8) {
+        case 0:
+            return 0;
+        case 1:
+        case 2:
+        case 3:
+            return (r >> 8) % 24;
+        case 4:
+        case 5:
+            return (r >> 8) % 300;
+        default:
+            return (r >> 8) % 5000;
+    }
+}
+
+/* Run input through a context in random chunks and compare the output with expected. */
+static void
+test_stream(int arch, int encoding, const uint8_t *input, const uint8_t *expected, size_t size, uint32_t seed,
+            uint8_t *out) {
+    BCJContext *ctx = NULL;
+    size_t inPos = 0, outPos = 0;
+    uint32_t first = seed;
+    int err = BCJ_ContextCreate(&ctx, arch, encoding, 0, 0);
+
+    TEST_CHECK(err == 0, "%s: BCJ_ContextCreate returned %d", archNames[arch], err);
+    if (err != 0) {
+        return;
+    }
+    while (inPos < size) {
+        size_t len = test_chunk(&seed);
+        if (len > size - inPos) {
+            len = size - inPos;
+        }
+        size_t outLen = BCJ_ContextUpdate(ctx, input + inPos, len, out + outPos);
+        inPos += len;
+        outPos += outLen;
+        TEST_CHECK(outPos <= inPos && inPos - outPos <= BCJ_CARRY_MAX,
+                   "%s %s: %zu bytes carried after %zu", archNames[arch], encoding ? "encode" : "decode",
+                   inPos - outPos, inPos);
+        TEST_CHECK(BCJ_ContextPosition(ctx) == inPos, "%s %s: position %llu for %zu", archNames[arch],
+                   encoding ? "encode" : "decode", (unsigned long long) BCJ_ContextPosition(ctx), inPos);
+    }
+    outPos += BCJ_ContextFinish(ctx, out + outPos);
+    TEST_CHECK(outPos == size && memcmp(out, expected, size) == 0, "%s %s: chunked output differs, seed %u",
+               archNames[arch], encoding ? "encode" : "decode", (unsigned) first);
+
+    // a reset context gives the same output again, in one update
+    err = BCJ_ContextReset(ctx, 0, 0);
+    TEST_CHECK(err == 0, "%s: BCJ_ContextReset returned %d", archNames[arch], err);
+    outPos = BCJ_ContextUpdate(ctx, input, size, out);
+    outPos += BCJ_ContextFinish(ctx, out + outPos);
+    TEST_CHECK(outPos == size && memcmp(out, expected, size) == 0, "%s %s: output after reset differs",
+               archNames[arch], encoding ? "encode" : "decode");
+    BCJ_ContextDestroy(ctx);
+}
+
+int
+main(int argc, char **argv) {
+    size_t size;
+    uint8_t *input, *out;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <vectors directory>\n", argv[0]);
+        return 2;
+    }
+    TEST_CHECK(BCJ_VersionNumber() == BCJ_VERSION_NUMBER, "linked version %u, header %u", BCJ_VersionNumber(),
+               (unsigned) BCJ_VERSION_NUMBER);
+    TEST_CHECK(strcmp(BCJ_VersionString(), BCJ_VERSION_STRING) == 0, "linked version %s", BCJ_VersionString());
+    input = test_read(argv[1], "input.bin", &size);
+    out = malloc(BCJ_UPDATE_BOUND(size));
+    if (input == NULL || out == NULL) {
+        return 1;
+    }
+    for (size_t arch = 0; arch < TEST_ARCHS; arch++) {
+        for (int encoding = 0; encoding < 2; encoding++) {
+            char name[64];
+            size_t expectedSize;
+            uint8_t *expected;
+
+            snprintf(name, sizeof(name), "%s_%s.bin", archNames[arch], encoding ? "encoded" : "decoded");
+            expected = test_read(argv[1], name, &expectedSize);
+            if (expected == NULL) {
+                failures++;
+                continue;
+            }
+            TEST_CHECK(expectedSize == size, "%s: size %zu, input %zu", name, expectedSize, size);
+            if (expectedSize == size) {
+                memcpy(out, input, size);
+                int err = encoding ? BCJ_Encode((int) arch, 0, out, size) : BCJ_Decode((int) arch, 0, out, size);
+                TEST_CHECK(err == 0 && memcmp(out, expected, size) == 0, "%s: one-shot output differs", name);
+                for (uint32_t round = 0; round < TEST_ROUNDS; round++) {
+                    test_stream((int) arch, encoding, input, expected, size, 0x9E3779B9u * (round + 1), out);
+                }
+            }
+            free(expected);
+        }
+    }
+    // arguments rejected as documented
+    {
+        BCJContext *ctx = NULL;
+        TEST_CHECK(BCJ_ContextCreate(&ctx, BCJ_ARCH_ARM64 + 1, BCJ_ENCODE, 0, 0) != 0, "unknown arch accepted");
+        TEST_CHECK(BCJ_ContextCreate(&ctx, BCJ_ARCH_IA64, BCJ_ENCODE, 8, 0) != 0, "unaligned offset accepted");
+        TEST_CHECK(BCJ_ContextCreate(&ctx, BCJ_ARCH_ARM, BCJ_ENCODE, 0, 1) != 0, "state accepted for arm");
+        TEST_CHECK(BCJ_Encode(BCJ_ARCH_ARMT, 1, out, size) != 0, "unaligned offset accepted");
+    }
+    free(out);
+    free(input);
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("libbcj %s: %zu architectures, both directions, %d chunked runs each\n", BCJ_VersionString(),
+           TEST_ARCHS, TEST_ROUNDS);
+    return 0;
+}